@@ -0,0 +1,548 @@
+// Simulates the motor controller of an ESA 5000 on a pseudo terminal, so the
+// dashboard can be tested without a scooter.
+//
+// build: g++ -O2 -std=c++17 -o controller-simulator controller-simulator.cpp
+// usage: ./controller-simulator [-l link] [-t factor] [-c probability] [-S seed]
+//            [-e time:key=value]... [-q]
+//
+// The simulator prints the path of the pty slave (or links it to -l), a host
+// build of the firmware opens it instead of the real UART. Like the real
+// controller it answers every input frame (address 25/27) with a motor info
+// frame (address 28) and requests for detailed info with the matching address
+// 11 frame, see docgreen-protocol.md. Option frames (address 22) switch eco
+// mode, lock and lights and set the max speed.
+//
+// Speed and battery follow a simple model: throttle and brake give a force
+// on scooter and rider, limited by the max speed, against rolling resistance
+// and drag. The motor current drains a 10S battery with internal resistance.
+//
+// -t runs the simulation factor times faster than real time.
+// -c makes received frames collide with a frame of the controller with the
+//    given probability: the input is lost and the answer garbled. -S seeds the
+//    random numbers, so runs are reproducible.
+// -e changes the state at a simulated time in seconds, keys are error (error
+//    code), button (button press flag), soc (state of charge in %) and
+//    shutdown (shutting down flag), e.g. -e 30:error=21 -e 40:error=0
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// calculateChecksum
+#include "../DocGreenDisplay/protocol-core.h"
+
+#define WHEEL_DIAMETER 0.2159 // m, 8.5"
+#define MASS 95.0 // kg, scooter and rider
+#define MAX_DRIVE_FORCE 60.0 // N at full throttle
+#define ECO_DRIVE_FACTOR 0.6
+#define MAX_BRAKE_FORCE 150.0 // N at full electric brake
+#define ROLLING_RESISTANCE 9.0 // N
+#define DRAG_FACTOR 0.35 // N per (m/s)^2
+#define MOTOR_EFFICIENCY 0.8
+#define REGEN_EFFICIENCY 0.3
+#define IDLE_CURRENT 0.05 // A
+
+#define BATTERY_CELLS 10
+#define BATTERY_CAPACITY 7.8 // Ah
+#define BATTERY_RESISTANCE 0.15 // Ohm
+
+#define THROTTLE_MIN 0x2C
+#define THROTTLE_MAX 0xC5
+#define BRAKE_MIN 0x2C
+#define BRAKE_MAX 0xB5
+
+#define SPEED_LIMIT_BAND 0.3 // m/s
+#define DEFAULT_MAX_RPM 491 // ~20 km/h, until the dashboard sets it
+#define INPUT_TIMEOUT 1.0 // s without input frames before the motor stops
+#define MAX_STEP 0.01 // s of simulated time per physics step
+#define MAINBOARD_VERSION 0x0003027d
+
+typedef struct
+{
+	double time;
+	std::string key;
+	long value;
+} script_event_t;
+
+static struct
+{
+	// set by the dashboard
+	uint8_t throttle;
+	uint8_t brake;
+	bool ecoMode;
+	bool locked;
+	bool lights;
+	uint16_t maxRpm;
+	double lastInput;
+
+	// set by events
+	uint8_t errorCode;
+	bool buttonPress;
+	bool shuttingDown;
+
+	// model
+	double time; // s since boot
+	double speed; // m/s
+	double current; // A
+	double soc; // 0 to 1
+	double voltage;
+	double odometer; // m
+	uint32_t totalOperationTime; // s before boot
+} sim;
+
+static struct
+{
+	uint32_t framesReceived;
+	uint32_t badFrames;
+	uint32_t collisions;
+	uint32_t framesSent;
+	uint32_t framesDropped;
+} stats;
+
+static int masterFd = -1;
+static double collisionProbability = 0;
+static volatile sig_atomic_t running = 1;
+static uint64_t rngState = 1;
+
+static uint32_t rngNext()
+{
+	// xorshift64
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 7;
+	rngState ^= rngState << 17;
+	return rngState >> 32;
+}
+
+static double rngUniform()
+{
+	return rngNext() / 4294967296.0;
+}
+
+static double realTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double clamp01(double val)
+{
+	return std::min(1.0, std::max(0.0, val));
+}
+
+//
+// model
+//
+
+static double openCircuitVoltage()
+{
+	// rough linear discharge curve of a li-ion cell
+	return BATTERY_CELLS * (3.3 + 0.9 * sim.soc);
+}
+
+static double maxSpeed()
+{
+	return sim.maxRpm * WHEEL_DIAMETER * M_PI / 60;
+}
+
+static void simulate(double dt)
+{
+	double throttle = clamp01((sim.throttle - THROTTLE_MIN) / (double)(THROTTLE_MAX - THROTTLE_MIN));
+	double brake = clamp01((sim.brake - BRAKE_MIN) / (double)(BRAKE_MAX - BRAKE_MIN));
+	if(sim.time - sim.lastInput > INPUT_TIMEOUT || sim.locked || sim.errorCode != 0 || sim.soc <= 0)
+		throttle = 0;
+
+	// the controller fades out the motor just below the max speed
+	double drive = throttle * MAX_DRIVE_FORCE * (sim.ecoMode ? ECO_DRIVE_FACTOR : 1);
+	drive *= clamp01((maxSpeed() - sim.speed) / SPEED_LIMIT_BAND);
+
+	double braking = brake * MAX_BRAKE_FORCE;
+	if(sim.speed <= 0)
+		braking = 0;
+
+	double resistance = sim.speed > 0 ? ROLLING_RESISTANCE + DRAG_FACTOR * sim.speed * sim.speed : 0;
+	double force = drive - braking - resistance;
+	sim.speed = std::max(0.0, sim.speed + force / MASS * dt);
+	sim.odometer += sim.speed * dt;
+
+	double power = drive * sim.speed / MOTOR_EFFICIENCY - braking * sim.speed * REGEN_EFFICIENCY;
+	sim.current = power / std::max(1.0, sim.voltage) + IDLE_CURRENT;
+	sim.soc = clamp01(sim.soc - sim.current * dt / 3600 / BATTERY_CAPACITY);
+	sim.voltage = openCircuitVoltage() - sim.current * BATTERY_RESISTANCE;
+	sim.time += dt;
+}
+
+static void applyEvent(const script_event_t& event)
+{
+	if(event.key == "error")
+		sim.errorCode = event.value;
+	else if(event.key == "button")
+		sim.buttonPress = event.value != 0;
+	else if(event.key == "soc")
+		sim.soc = clamp01(event.value / 100.0);
+	else if(event.key == "shutdown")
+		sim.shuttingDown = event.value != 0;
+
+	fprintf(stderr, "%.3f: %s=%ld\n", sim.time, event.key.c_str(), event.value);
+}
+
+//
+// bus
+//
+
+static void setLE(uint8_t *data, uint8_t size, uint32_t val)
+{
+	for(uint8_t i = 0; i < size; i++)
+		data[i] = val >> (8 * i);
+}
+
+// data starts with the length byte, the header and checksum are added here
+static void sendFrame(uint8_t *data, bool collided)
+{
+	uint16_t len = data[0] + 2;
+	uint8_t buff[2 + 256 + 2] = {0x55, 0xAA};
+	memcpy(buff + 2, data, len);
+	setLE(buff + 2 + len, 2, calculateChecksum(data));
+
+	size_t size = len + 4;
+	if(collided)
+	{
+		// the other sender overwrote some bits or the frame stopped early
+		buff[2 + rngNext() % (size - 2)] ^= 1 << (rngNext() % 8);
+		if(rngNext() % 2)
+			size = 2 + rngNext() % (size - 2);
+	}
+
+	// nobody might be reading the slave, drop frames instead of blocking
+	if(write(masterFd, buff, size) != (ssize_t)size)
+		stats.framesDropped++;
+	else
+		stats.framesSent++;
+}
+
+static void sendMotorInfo(bool collided)
+{
+	uint8_t data[0x0b + 2] = {0x0B, 0x28, 0x6D, 0x09};
+	data[4] = sim.ecoMode ? 0x02 : 0x00;
+	data[5] = sim.shuttingDown ? 0x08 : 0x07;
+	data[6] = sim.lights ? 0x01 : 0x00;
+	setLE(data + 8, 2, lround(sim.speed * 3600)); // meters per hour
+	data[10] = sim.buttonPress ? 0x01 : 0x00;
+	data[11] = sim.errorCode;
+	data[12] = lround(sim.soc * 100);
+	sendFrame(data, collided);
+}
+
+static void sendDetailedInfo(uint8_t arg, bool collided)
+{
+	uint8_t data[0x34 + 2] = {0x34, 0x11, 0x33, arg};
+	if(arg == 0x00)
+	{
+		setLE(data + 4, 4, sim.totalOperationTime + (uint32_t)sim.time);
+		setLE(data + 20, 4, (uint32_t)sim.time);
+		setLE(data + 46, 2, lround(sim.voltage * 100));
+		setLE(data + 48, 2, (uint16_t)(int16_t)lround(sim.current * 100));
+	}
+	else
+	{
+		setLE(data + 10, 4, MAINBOARD_VERSION);
+		data[20] = lround(sim.soc * 100);
+		setLE(data + 28, 2, lround(sim.speed * 3600));
+		setLE(data + 34, 4, lround(sim.odometer));
+	}
+	sendFrame(data, collided);
+}
+
+// data starts with the length byte and doesn't include the checksum
+static void handleFrame(const uint8_t *data)
+{
+	uint8_t len = data[0];
+	uint8_t addr = data[1];
+	uint8_t cmd = data[2];
+	uint8_t arg = data[3];
+	stats.framesReceived++;
+
+	bool collided = rngUniform() < collisionProbability;
+	if(collided)
+	{
+		stats.collisions++;
+		if(addr == 0x25 || addr == 0x27)
+			sendMotorInfo(true);
+		return;
+	}
+
+	if(addr == 0x25 && cmd == 0x60 && len == 0x07)
+	{
+		sim.throttle = data[5];
+		sim.brake = data[6];
+		sim.lastInput = sim.time;
+		sendMotorInfo(false);
+	}
+	else if(addr == 0x27 && len == 0x09)
+	{
+		sim.throttle = data[5];
+		sim.brake = data[6];
+		sim.lastInput = sim.time;
+		sendMotorInfo(false);
+	}
+	else if(addr == 0x25 && cmd == 0x64 && len == 0x07)
+	{
+		sim.throttle = data[6];
+		sim.brake = data[7];
+		sim.lastInput = sim.time;
+
+		// only the requests for the known detailed info packets are answered
+		if(arg == 0x37 && data[4] == 0x32)
+			sendDetailedInfo(0x00, false);
+		else if(arg == 0x1F && data[4] == 0x32)
+			sendDetailedInfo(0x28, false);
+		else
+			sendMotorInfo(false);
+	}
+	else if(addr == 0x22 && len == 0x04)
+	{
+		if(arg == 0x7C)
+			sim.ecoMode = data[4] != 0;
+		else if(arg == 0x7D)
+			sim.locked = data[4] != 0;
+		else if(arg == 0xF0)
+			sim.lights = data[4] != 0;
+		else if(arg == 0xF2)
+			sim.maxRpm = data[4] | data[5] << 8;
+	}
+}
+
+static struct
+{
+	uint8_t headerPos; // 55 AA bytes seen
+	uint16_t pos; // bytes after 55 AA
+	uint8_t data[256 + 4];
+} rx;
+
+static void receiveByte(uint8_t val)
+{
+	if(rx.headerPos < 2)
+	{
+		if(val == 0x55)
+			rx.headerPos = 1;
+		else if(val == 0xAA && rx.headerPos == 1)
+			rx.headerPos = 2;
+		else
+			rx.headerPos = 0;
+
+		rx.pos = 0;
+		return;
+	}
+
+	rx.data[rx.pos++] = val;
+	uint16_t total = (uint16_t)rx.data[0] + 4; // length, address, payload and checksum
+	if(rx.pos < 4 || rx.pos < total)
+		return;
+
+	uint16_t checksum = rx.data[total - 2] | rx.data[total - 1] << 8;
+	if(checksum == calculateChecksum(rx.data))
+		handleFrame(rx.data);
+	else
+		stats.badFrames++;
+
+	rx.headerPos = 0;
+}
+
+//
+// pty
+//
+
+static bool openPty(const char *linkPath)
+{
+	masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+	if(masterFd < 0 || grantpt(masterFd) != 0 || unlockpt(masterFd) != 0)
+	{
+		perror("posix_openpt");
+		return false;
+	}
+
+	const char *slavePath = ptsname(masterFd);
+
+	// raw bytes like a UART, keeping the slave open avoids errors on the
+	// master while no dashboard is connected
+	int slaveFd = open(slavePath, O_RDWR | O_NOCTTY);
+	struct termios tio;
+	if(slaveFd < 0 || tcgetattr(slaveFd, &tio) != 0)
+	{
+		perror(slavePath);
+		return false;
+	}
+	cfmakeraw(&tio);
+	cfsetspeed(&tio, B115200);
+	tcsetattr(slaveFd, TCSANOW, &tio);
+
+	fcntl(masterFd, F_SETFL, fcntl(masterFd, F_GETFL) | O_NONBLOCK);
+
+	if(linkPath != NULL)
+	{
+		unlink(linkPath);
+		if(symlink(slavePath, linkPath) != 0)
+		{
+			perror(linkPath);
+			return false;
+		}
+		printf("%s -> %s\n", linkPath, slavePath);
+	}
+	else
+	{
+		printf("%s\n", slavePath);
+	}
+	fflush(stdout);
+	return true;
+}
+
+static void stop(int)
+{
+	running = 0;
+}
+
+static bool parseEvent(const char *arg, std::vector<script_event_t>& events)
+{
+	char key[32];
+	double time;
+	long value;
+	if(sscanf(arg, "%lf:%31[a-z]=%li", &time, key, &value) != 3)
+	{
+		fprintf(stderr, "invalid event %s, expected time:key=value\n", arg);
+		return false;
+	}
+
+	events.push_back({time, key, value});
+	return true;
+}
+
+static void printStatus()
+{
+	printf("%8.1fs %5.1f km/h %3.0f%% %5.2f V %6.2f A error %u%s%s%s, "
+		"%u frames received (%u bad, %u collisions), %u sent (%u dropped)\n",
+		sim.time, sim.speed * 3.6, sim.soc * 100, sim.voltage, sim.current, sim.errorCode,
+		sim.ecoMode ? " eco" : "", sim.lights ? " lights" : "", sim.locked ? " locked" : "",
+		stats.framesReceived, stats.badFrames, stats.collisions, stats.framesSent, stats.framesDropped);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	const char *linkPath = NULL;
+	double factor = 1;
+	bool quiet = false;
+	std::vector<script_event_t> events;
+
+	int opt;
+	while((opt = getopt(argc, argv, "l:t:c:S:e:q")) != -1)
+	{
+		switch(opt)
+		{
+			case 'l':
+				linkPath = optarg;
+				break;
+			case 't':
+				factor = strtod(optarg, NULL);
+				break;
+			case 'c':
+				collisionProbability = strtod(optarg, NULL);
+				break;
+			case 'S':
+				rngState = strtoull(optarg, NULL, 10) | 1;
+				break;
+			case 'e':
+				if(!parseEvent(optarg, events))
+					return 1;
+				break;
+			case 'q':
+				quiet = true;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-l link] [-t factor] [-c probability] [-S seed] "
+					"[-e time:key=value]... [-q]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	if(factor <= 0)
+	{
+		fprintf(stderr, "the time factor has to be positive\n");
+		return 1;
+	}
+
+	std::stable_sort(events.begin(), events.end(), [](const script_event_t& a, const script_event_t& b) {
+		return a.time < b.time;
+	});
+
+	sim.maxRpm = DEFAULT_MAX_RPM;
+	sim.lastInput = -INPUT_TIMEOUT;
+	sim.soc = 0.8;
+	sim.voltage = openCircuitVoltage();
+	sim.odometer = 18864;
+	sim.totalOperationTime = 27366;
+
+	if(!openPty(linkPath))
+		return 1;
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	size_t nextEvent = 0;
+	double nextStatus = 1;
+	double lastReal = realTime();
+	while(running)
+	{
+		struct pollfd pfd = {masterFd, POLLIN, 0};
+		poll(&pfd, 1, 1);
+
+		uint8_t buff[256];
+		ssize_t len;
+		while((len = read(masterFd, buff, sizeof(buff))) > 0)
+		{
+			for(ssize_t i = 0; i < len; i++)
+				receiveByte(buff[i]);
+		}
+
+		double now = realTime();
+		double dt = (now - lastReal) * factor;
+		lastReal = now;
+
+		while(dt > 0)
+		{
+			double step = std::min(dt, MAX_STEP);
+			if(nextEvent < events.size())
+				step = std::min(step, std::max(0.0, events[nextEvent].time - sim.time));
+
+			simulate(step);
+			dt -= step;
+
+			while(nextEvent < events.size() && events[nextEvent].time <= sim.time)
+				applyEvent(events[nextEvent++]);
+
+			if(!quiet && sim.time >= nextStatus)
+			{
+				printStatus();
+				nextStatus += 1;
+			}
+		}
+	}
+
+	if(linkPath != NULL)
+		unlink(linkPath);
+
+	printStatus();
+	return 0;
+}
\ No newline at end of file
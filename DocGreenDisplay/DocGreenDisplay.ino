@@ -4,6 +4,8 @@
 #include "config.h"
 #include "state.hpp"
 #include "protocol.h"
+#include "settings.hpp"
+#include "boot.hpp"
 
 #include "wifi.hpp"
 #include "oled-ui.hpp"
@@ -11,8 +13,11 @@
 #include "webserver.hpp"
 #include "bluetooth.hpp"
 #include "update.hpp"
+#include "logging.hpp"
+#include "commands.hpp"
 
 Preferences preferences;
+SemaphoreHandle_t stateMutex;
 
 docgreen_status_t scooterStatus = {
 	.enableStatsRequests = true,
@@ -20,8 +25,48 @@ docgreen_status_t scooterStatus = {
 
 bool lightPinStatus = false;
 
+// everything not needed to talk to the motor controller
+static void setupServices()
+{
+	wifiSetup();
+	bootMark(BOOT_WIFI);
+
+	initializeOledUi();
+	bootMark(BOOT_OLED);
+
+	webServerSetup();
+	bootMark(BOOT_WEBSERVER);
+
+	bluetoothSetup();
+	bootMark(BOOT_BLUETOOTH);
+
+	if(wifiApEnabled || wifiStaEnabled)
+	{
+		MDNS.begin(MDNS_DOMAIN_NAME); // TODO allow the user to configure this?
+		MDNS.addService("http", "tcp", 80);
+	}
+
+	if(wifiStaEnabled)
+		configTime(0, 0, NTP_SERVER_1, NTP_SERVER_2, NTP_SERVER_3);
+	bootMark(BOOT_NETWORK_SERVICES);
+
+	setupFirmwareUpdate();
+
+	// e.g. the generated WiFi credentials
+	settingsCommit();
+	bootMark(BOOT_DONE);
+}
+
+static void setupServicesTaskMain(void *arg)
+{
+	setupServices();
+	vTaskDelete(NULL);
+}
+
 void setup()
 {
+	bootMark(BOOT_SETUP);
+
 #ifdef ARDUINO_ARCH_ESP32
 	ScooterSerial.begin(115200, SERIAL_8N1, 27, 26);
 
@@ -31,39 +76,40 @@ void setup()
 	ScooterSerial.begin(115200);
 #endif
 
+	stateMutex = xSemaphoreCreateMutex();
+	busCommandSetup();
+
 	pinMode(MECHANICAL_BRAKE_PIN, INPUT);
 	preferences.begin("scooter", false);
+	settingsLoad();
+	historyLoad();
+	bootMark(BOOT_SETTINGS);
 
 	pinMode(LED_MOSFET_PIN, OUTPUT);
 	digitalWrite(LED_MOSFET_PIN, LOW);
 
-	wifiSetup();
-	initializeOledUi();
-	webServerSetup();
-	bluetoothSetup();
+	isLocked = settings.lockOnBoot;
+	snapshotSetup(esp_random());
 
-	if(wifiApEnabled || wifiStaEnabled)
+	// repeated by the bus command queue, to make sure the packet isn't lost.
+	// The lock is queued here as well, with fast boot the display showing the
+	// lock menu is only ready seconds after the first input frame.
+	if(settings.maxSpeed != 20)
+		queueBusCommand(BUS_COMMAND_MAX_SPEED, settings.maxSpeed);
+	if(settings.lockOnBoot)
+		queueBusCommand(BUS_COMMAND_LOCK, true);
+
+	// WiFi, the display intro and BLE take seconds, with fast boot they are
+	// set up next to the main loop, which starts sending input frames at once
+	if(settings.fastBoot)
 	{
-		MDNS.begin(MDNS_DOMAIN_NAME); // TODO allow the user to configure this?
-		MDNS.addService("http", "tcp", 80);
+		xTaskCreatePinnedToCore(setupServicesTaskMain, "boot", BOOT_TASK_STACK,
+			NULL, BOOT_TASK_PRIORITY, NULL, BOOT_TASK_CORE);
 	}
-
-	if(wifiStaEnabled)
-		configTime(0, 0, NTP_SERVER_1, NTP_SERVER_2, NTP_SERVER_3);
-
-	configuredSpeed = preferences.getUChar(PREFERENCE_MAX_SPEED, 20);
-	if(configuredSpeed != 20)
+	else
 	{
-		// send default max speed 3 times, to make sure the packet isn't lost
-		setMaxSpeed(configuredSpeed);
-		setMaxSpeed(configuredSpeed);
-		setMaxSpeed(configuredSpeed);
+		setupServices();
 	}
-
-	if(preferences.getUChar(PREFERENCE_REENABLE_LIGHT, 0))
-		reenableLightsAfterError = true;
-
-	setupFirmwareUpdate();
 }
 
 void loop()
@@ -104,14 +150,24 @@ void loop()
 		throttle = map(throttle, THROTTLE_READ_MIN, THROTTLE_READ_MAX, THROTTLE_MIN, THROTTLE_MAX);
 		brake = map(brake, BRAKE_READ_MIN, BRAKE_READ_MAX, BRAKE_MIN, BRAKE_MAX);
 
+		// the throttle also selects the pin digits, so it is only read, not sent
+		if(isLocked)
+			throttle = THROTTLE_MIN;
+
 		scooterStatus.throttle = throttle;
 		scooterStatus.brake = brake;
 		transmitInputInfo(scooterStatus);
+		bootMark(BOOT_FIRST_INPUT_FRAME);
 		lastTransmit = now;
 	}
 
+	busCommandLoop();
+	bluetoothRequestLoop();
+
 	if(ScooterSerial.available() && receivePacket(&scooterStatus))
 	{
+		xSemaphoreTake(stateMutex, portMAX_DELAY);
+
 		static bool hadButton = false;
 		if(scooterStatus.buttonPress)
 		{
@@ -130,13 +186,20 @@ void loop()
 		}
 
 		reenableLightLoop(scooterStatus);
+		historyUpdate(scooterStatus);
+		snapshotUpdate(scooterStatus);
 
 		// TODO do this more often?
 		// not only after a packet from the motor controller was received?
 		updateOledUi(scooterStatus);
 		bluetoothLoop(scooterStatus);
+
+		xSemaphoreGive(stateMutex);
+
+		// the flash writes of changes made in the menus
+		settingsCommit();
+		historySave();
 	}
 
-	webServerLoop();
 	delay(1);
 }
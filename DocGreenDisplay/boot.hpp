@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "state.hpp"
+
+// Timestamps of the boot phases in microseconds since reset, exposed on
+// /stats/boot. A phase which was not reached yet stays 0.
+
+static const char *bootPhaseNames[] = {
+	"setup",
+	"settings",
+	"firstInputFrame",
+	"wifi",
+	"oled",
+	"webserver",
+	"bluetooth",
+	"networkServices",
+	"done",
+};
+
+static_assert(sizeof(bootPhaseNames) / sizeof(*bootPhaseNames) == BOOT_PHASE_COUNT,
+	"bootPhaseNames does not match boot_phase_t.");
+
+uint32_t bootTimestamps[BOOT_PHASE_COUNT];
+
+void bootMark(boot_phase_t phase)
+{
+	if(bootTimestamps[phase] == 0)
+		bootTimestamps[phase] = micros();
+}
\ No newline at end of file
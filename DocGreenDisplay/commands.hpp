@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#include "config.h"
+#include "state.hpp"
+#include "protocol.h"
+
+// The main loop is the only one writing to ScooterSerial. Other tasks (e.g.
+// the webserver) queue their commands here, the main loop then sends them in
+// between the input frames without blocking.
+
+static QueueHandle_t busCommandQueue;
+
+void busCommandSetup()
+{
+	busCommandQueue = xQueueCreate(BUS_COMMAND_QUEUE_LENGTH, sizeof(bus_command_t));
+}
+
+bool queueBusCommand(bus_command_type_t type, uint8_t value)
+{
+	bus_command_t command = {type, value};
+	return xQueueSend(busCommandQueue, &command, 0) == pdTRUE;
+}
+
+// state changes which have to happen once per command, not per repetition
+static void applyBusCommand(const bus_command_t& command)
+{
+	switch(command.type)
+	{
+		case BUS_COMMAND_LOCK:
+			isLocked = command.value;
+			break;
+		case BUS_COMMAND_LIGHT:
+			rememberLightState(command.value);
+			break;
+		default:
+			break;
+	}
+}
+
+static void sendBusCommand(const bus_command_t& command)
+{
+	switch(command.type)
+	{
+		case BUS_COMMAND_MAX_SPEED:
+			setMaxSpeed(command.value);
+			break;
+		case BUS_COMMAND_ECO_MODE:
+			setEcoMode(command.value);
+			break;
+		case BUS_COMMAND_LOCK:
+			setLock(command.value);
+			break;
+		case BUS_COMMAND_LIGHT:
+			setLight(command.value);
+			break;
+	}
+}
+
+// sends at most one frame per call, every command is repeated
+// BUS_COMMAND_REPEATS times to make sure it isn't lost in a collision
+void busCommandLoop()
+{
+	static bus_command_t current;
+	static uint8_t repeatsLeft = 0;
+	static uint32_t lastSend = 0;
+
+	uint32_t now = millis();
+	if(repeatsLeft == 0)
+	{
+		if(xQueueReceive(busCommandQueue, &current, 0) != pdTRUE)
+			return;
+
+		applyBusCommand(current);
+		repeatsLeft = BUS_COMMAND_REPEATS;
+	}
+	else if(now - lastSend < BUS_COMMAND_REPEAT_INTERVAL)
+	{
+		return;
+	}
+
+	sendBusCommand(current);
+	lastSend = now;
+	repeatsLeft--;
+}
\ No newline at end of file
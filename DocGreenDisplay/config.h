@@ -27,4 +27,71 @@
 #define NTP_SERVER_2 "ptbtime2.ptb.de"
 #define NTP_SERVER_3 "ntp.uni-regensburg.de"
 
-#define DEFAULT_UPDATE_URL "https://jakobloew.me/scooter/dashboard.bin"
\ No newline at end of file
+#define DEFAULT_UPDATE_URL "https://jakobloew.me/scooter/dashboard.bin"
+
+// number of entries of the long-term history tiers in logging.hpp, about
+// 15 KB of the ~100 KB heap left next to WiFi and BLE. Seconds and minutes
+// use 4 bytes per entry and only cover the current boot, hours use 12 bytes
+// and are kept in NVS, HISTORY_HOURS_CHUNK entries per key.
+#define HISTORY_SECONDS 900 // last 15 minutes
+#define HISTORY_MINUTES (24 * 60) // last day
+#define HISTORY_HOURS 512 // ~21 days of operation
+#define HISTORY_HOURS_CHUNK 32
+
+// port of the server-sent events status stream (see webserver.hpp)
+#define STREAM_PORT 81
+#define STREAM_MAX_CLIENTS 4
+// per client event interval in ms, grows up to the max for slow clients
+#define STREAM_MIN_INTERVAL 50
+#define STREAM_MAX_INTERVAL 1000
+// writes taking longer than this (in ms) count as slow
+#define STREAM_SLOW_WRITE 5
+#define STREAM_KEEPALIVE_INTERVAL 10000
+
+// passive sniffer (see sniffer.hpp), the ring keeps the last frames of the
+// bus, frames longer than SNIFFER_FRAME_MAX (the detailed info) are truncated
+#define SNIFFER_PORT 82
+#define SNIFFER_RING_SIZE 256
+#define SNIFFER_FRAME_MAX 56
+// a pause (in us) inside a frame ends it, e.g. after a collision corrupted its
+// length byte. Bytes are timestamped when the main loop reads them, so this
+// has to be longer than the main loop stalls while a frame arrives.
+#define SNIFFER_FRAME_GAP 2000
+#define SNIFFER_SEND_BUFFER 1460
+
+// commands queued for the motor controller by other tasks (see commands.hpp)
+#define BUS_COMMAND_QUEUE_LENGTH 16
+#define BUS_COMMAND_REPEATS 3
+// ms between two repetitions of the same command
+#define BUS_COMMAND_REPEAT_INTERVAL 20
+
+// the webserver runs in its own task on the core running the WiFi stack,
+// the main loop talking to the motor controller runs on the other one
+#define WEBSERVER_TASK_CORE 0
+#define WEBSERVER_TASK_PRIORITY 1
+#define WEBSERVER_TASK_STACK 8192
+
+// sets up WiFi, the display and BLE next to the main loop with fast boot
+#define BOOT_TASK_CORE 0
+#define BOOT_TASK_PRIORITY 1
+#define BOOT_TASK_STACK 8192
+
+// sends the sniffed frames, writes block while the capture client is slow
+#define SNIFFER_TASK_CORE 0
+#define SNIFFER_TASK_PRIORITY 1
+#define SNIFFER_TASK_STACK 4096
+
+#define OTA_TASK_CORE 0
+#define OTA_TASK_PRIORITY 1
+#define OTA_TASK_STACK 10240
+#define OTA_BUFFER_SIZE 1024
+#define DELTA_COPY_BUFFER 1024
+#define OTA_NTP_TIMEOUT 10000
+#define OTA_READ_TIMEOUT 10000
+#define OTA_STATUS_INTERVAL 500
+
+#define BLE_REQUEST_QUEUE_LENGTH 8
+#define BLE_REQUEST_MAX_LENGTH 32
+#define BLE_MTU 185
+// 0 disables pushing the telemetry registers
+#define BLE_TELEMETRY_INTERVAL 200
\ No newline at end of file
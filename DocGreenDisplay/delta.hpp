@@ -0,0 +1,297 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+
+#include "config.h"
+
+// Delta images describe a new firmware as a list of operations against the
+// image in the running partition, they are generated by make-delta.py.
+// All numbers are little endian:
+//
+// header: "DGD1", base size (u32), base SHA-256, target size (u32), target SHA-256
+// 0x00: end of the delta
+// 0x01 <offset u32> <length u32>: copy bytes of the running image
+// 0x02 <length u32> <data>: insert the following bytes
+//
+// The patcher is fed with chunks of any size and writes the reconstructed
+// image to Update, only the header and the copy buffer are kept in RAM.
+
+#define DELTA_MAGIC "DGD1"
+#define DELTA_HEADER_SIZE 76
+
+#define DELTA_OP_END 0x00
+#define DELTA_OP_COPY 0x01
+#define DELTA_OP_INSERT 0x02
+
+// returned when the delta was made for a different firmware, the caller should
+// fall back to the full image
+static const char deltaErrorBaseMismatch[] = "delta base mismatch";
+
+typedef enum : uint8_t
+{
+	DELTA_STATE_HEADER,
+	DELTA_STATE_OP,
+	DELTA_STATE_COPY_ARGS,
+	DELTA_STATE_INSERT_ARGS,
+	DELTA_STATE_INSERT_DATA,
+	DELTA_STATE_END,
+} delta_state_t;
+
+typedef struct
+{
+	delta_state_t state;
+	// gathers the header and op arguments, which may be split across chunks
+	uint8_t buff[DELTA_HEADER_SIZE];
+	uint8_t buffLength;
+	uint8_t needed;
+
+	uint32_t baseSize;
+	uint32_t targetSize;
+	uint8_t targetHash[32];
+
+	uint32_t remaining; // bytes left of the current insert
+	uint32_t written;
+	bool hashing;
+	mbedtls_sha256_context hash;
+	const esp_partition_t *base;
+	const char *error;
+} delta_patcher_t;
+
+static uint8_t deltaCopyBuffer[DELTA_COPY_BUFFER];
+
+static uint32_t deltaReadU32(const uint8_t *data)
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static bool deltaOutput(delta_patcher_t& patcher, const uint8_t *data, size_t len)
+{
+	if(len > patcher.targetSize - patcher.written)
+	{
+		patcher.error = "delta exceeds target size";
+		return false;
+	}
+
+	mbedtls_sha256_update(&patcher.hash, data, len);
+	if(Update.write((uint8_t *)data, len) != len)
+	{
+		patcher.error = Update.errorString();
+		return false;
+	}
+
+	patcher.written += len;
+	return true;
+}
+
+static bool deltaBaseMatches(delta_patcher_t& patcher, const uint8_t *expectedHash)
+{
+	patcher.base = esp_ota_get_running_partition();
+	if(patcher.base == NULL || patcher.baseSize > patcher.base->size)
+		return false;
+
+	mbedtls_sha256_context hash;
+	mbedtls_sha256_init(&hash);
+	mbedtls_sha256_starts(&hash, 0);
+
+	bool ok = true;
+	for(uint32_t offset = 0; ok && offset < patcher.baseSize; offset += DELTA_COPY_BUFFER)
+	{
+		uint32_t len = patcher.baseSize - offset;
+		if(len > DELTA_COPY_BUFFER)
+			len = DELTA_COPY_BUFFER;
+
+		ok = esp_partition_read(patcher.base, offset, deltaCopyBuffer, len) == ESP_OK;
+		mbedtls_sha256_update(&hash, deltaCopyBuffer, len);
+	}
+
+	uint8_t actual[32];
+	mbedtls_sha256_finish(&hash, actual);
+	mbedtls_sha256_free(&hash);
+
+	return ok && memcmp(actual, expectedHash, sizeof(actual)) == 0;
+}
+
+static void deltaProcessHeader(delta_patcher_t& patcher)
+{
+	const uint8_t *header = patcher.buff;
+	patcher.baseSize = deltaReadU32(header + 4);
+	patcher.targetSize = deltaReadU32(header + 40);
+	memcpy(patcher.targetHash, header + 44, sizeof(patcher.targetHash));
+
+	if(memcmp(header, DELTA_MAGIC, 4) != 0)
+	{
+		patcher.error = "invalid delta";
+		return;
+	}
+	if(!deltaBaseMatches(patcher, header + 8))
+	{
+		patcher.error = deltaErrorBaseMismatch;
+		return;
+	}
+	if(!Update.begin(patcher.targetSize))
+	{
+		patcher.error = Update.errorString();
+		return;
+	}
+
+	mbedtls_sha256_init(&patcher.hash);
+	mbedtls_sha256_starts(&patcher.hash, 0);
+	patcher.hashing = true;
+
+	patcher.state = DELTA_STATE_OP;
+	patcher.needed = 1;
+}
+
+static void deltaProcessCopy(delta_patcher_t& patcher)
+{
+	uint32_t offset = deltaReadU32(patcher.buff);
+	uint32_t len = deltaReadU32(patcher.buff + 4);
+	if(offset > patcher.baseSize || len > patcher.baseSize - offset)
+	{
+		patcher.error = "delta copy out of range";
+		return;
+	}
+
+	while(len > 0)
+	{
+		uint32_t curr = len > DELTA_COPY_BUFFER ? DELTA_COPY_BUFFER : len;
+		if(esp_partition_read(patcher.base, offset, deltaCopyBuffer, curr) != ESP_OK)
+		{
+			patcher.error = "reading running partition failed";
+			return;
+		}
+		if(!deltaOutput(patcher, deltaCopyBuffer, curr))
+			return;
+
+		offset += curr;
+		len -= curr;
+	}
+
+	patcher.state = DELTA_STATE_OP;
+	patcher.needed = 1;
+}
+
+// handles a complete header, op or op arguments in patcher.buff
+static void deltaProcess(delta_patcher_t& patcher)
+{
+	switch(patcher.state)
+	{
+		case DELTA_STATE_HEADER:
+			deltaProcessHeader(patcher);
+			break;
+
+		case DELTA_STATE_OP:
+			if(patcher.buff[0] == DELTA_OP_END)
+			{
+				patcher.state = DELTA_STATE_END;
+			}
+			else if(patcher.buff[0] == DELTA_OP_COPY)
+			{
+				patcher.state = DELTA_STATE_COPY_ARGS;
+				patcher.needed = 8;
+			}
+			else if(patcher.buff[0] == DELTA_OP_INSERT)
+			{
+				patcher.state = DELTA_STATE_INSERT_ARGS;
+				patcher.needed = 4;
+			}
+			else
+			{
+				patcher.error = "invalid delta op";
+			}
+			break;
+
+		case DELTA_STATE_COPY_ARGS:
+			deltaProcessCopy(patcher);
+			break;
+
+		case DELTA_STATE_INSERT_ARGS:
+			patcher.remaining = deltaReadU32(patcher.buff);
+			patcher.state = patcher.remaining > 0 ? DELTA_STATE_INSERT_DATA : DELTA_STATE_OP;
+			patcher.needed = 1;
+			break;
+
+		default:
+			break;
+	}
+}
+
+void deltaBegin(delta_patcher_t& patcher)
+{
+	memset(&patcher, 0, sizeof(patcher));
+	patcher.state = DELTA_STATE_HEADER;
+	patcher.needed = DELTA_HEADER_SIZE;
+}
+
+bool deltaWrite(delta_patcher_t& patcher, const uint8_t *data, size_t len)
+{
+	while(len > 0 && patcher.error == NULL)
+	{
+		if(patcher.state == DELTA_STATE_INSERT_DATA)
+		{
+			size_t curr = len < patcher.remaining ? len : patcher.remaining;
+			if(!deltaOutput(patcher, data, curr))
+				break;
+
+			data += curr;
+			len -= curr;
+			patcher.remaining -= curr;
+			if(patcher.remaining == 0)
+				patcher.state = DELTA_STATE_OP;
+			continue;
+		}
+		else if(patcher.state == DELTA_STATE_END)
+		{
+			patcher.error = "data after end of delta";
+			break;
+		}
+
+		size_t curr = patcher.needed - patcher.buffLength;
+		if(curr > len)
+			curr = len;
+
+		memcpy(patcher.buff + patcher.buffLength, data, curr);
+		patcher.buffLength += curr;
+		data += curr;
+		len -= curr;
+
+		if(patcher.buffLength == patcher.needed)
+		{
+			patcher.buffLength = 0;
+			deltaProcess(patcher);
+		}
+	}
+
+	return patcher.error == NULL;
+}
+
+// releases the hash, Update has to be ended or aborted by the caller
+void deltaFree(delta_patcher_t& patcher)
+{
+	if(patcher.hashing)
+		mbedtls_sha256_free(&patcher.hash);
+	patcher.hashing = false;
+}
+
+// checks the reconstructed image, returns an error or NULL if it can be booted
+const char *deltaEnd(delta_patcher_t& patcher)
+{
+	if(patcher.error == NULL && (patcher.state != DELTA_STATE_END || patcher.written != patcher.targetSize))
+		patcher.error = "delta incomplete";
+
+	if(patcher.error == NULL)
+	{
+		uint8_t hash[32];
+		mbedtls_sha256_finish(&patcher.hash, hash);
+		if(memcmp(hash, patcher.targetHash, sizeof(hash)) != 0)
+			patcher.error = "delta result hash mismatch";
+	}
+
+	deltaFree(patcher);
+	return patcher.error;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <map>
+#include <string>
+
+// Text mode of Adafruit GFX, instead of pixels the screen keeps the text
+// printed per row (the y coordinate) and a placeholder for bitmaps. Cursor
+// movement, wrapping and rotation match the real library with its 6x8 font.
+
+class Adafruit_GFX: public Print
+{
+public:
+	Adafruit_GFX(int16_t width, int16_t height) : rawWidth(width), rawHeight(height) {}
+
+	void setRotation(uint8_t val)
+	{
+		rotation = val & 3;
+	}
+	int16_t width() { return rotation & 1 ? rawHeight : rawWidth; }
+	int16_t height() { return rotation & 1 ? rawWidth : rawHeight; }
+
+	void setTextSize(uint8_t size)
+	{
+		textSize = size > 0 ? size : 1;
+	}
+	void setTextColor(uint16_t color)
+	{
+		inverted = false;
+	}
+	void setTextColor(uint16_t color, uint16_t background)
+	{
+		inverted = color == 0 && background != 0;
+	}
+	void setCursor(int16_t x, int16_t y)
+	{
+		cursorX = x;
+		cursorY = y;
+	}
+	int16_t getCursorX() { return cursorX; }
+	int16_t getCursorY() { return cursorY; }
+
+	void drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t color)
+	{
+		char buff[32];
+		snprintf(buff, sizeof(buff), "<bitmap %dx%d>", w, h);
+		rows[y] += buff;
+	}
+
+	using Print::write;
+	size_t write(uint8_t c) override
+	{
+		if(c == '\n')
+		{
+			cursorX = 0;
+			cursorY += textSize * 8;
+			return 1;
+		}
+		else if(c == '\r')
+		{
+			return 1;
+		}
+
+		if(cursorX + textSize * 6 > width())
+		{
+			cursorX = 0;
+			cursorY += textSize * 8;
+		}
+
+		// larger text is marked with its size, inverted (selected) text with >
+		std::string& row = rows[cursorY];
+		if(row.empty() && textSize > 1)
+			row = "x" + std::to_string(textSize) + " ";
+		if(row.empty() && inverted)
+			row = "> ";
+		row += (char)c;
+		cursorX += textSize * 6;
+		return 1;
+	}
+
+protected:
+	std::map<int16_t, std::string> rows;
+
+private:
+	int16_t rawWidth;
+	int16_t rawHeight;
+	uint8_t rotation = 0;
+	uint8_t textSize = 1;
+	bool inverted = false;
+	int16_t cursorX = 0;
+	int16_t cursorY = 0;
+};
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_GFX.h>
+
+#define SSD1306_SWITCHCAPVCC 0x02
+#define SSD1306_SETCONTRAST 0x81
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+
+// display() prints the screen to stdout when hostPrintScreens is set and
+// the screen changed, prefixed with the virtual time in ms
+static bool hostPrintScreens = false;
+static uint32_t hostScreenUpdates = 0;
+
+class Adafruit_SSD1306: public Adafruit_GFX
+{
+public:
+	Adafruit_SSD1306(int16_t width, int16_t height, TwoWire *wire, int8_t reset)
+		: Adafruit_GFX(width, height) {}
+
+	bool begin(uint8_t vcc, uint8_t address) { return true; }
+	void ssd1306_command(uint8_t command) {}
+
+	void clearDisplay()
+	{
+		rows.clear();
+	}
+
+	void display()
+	{
+		hostScreenUpdates++;
+
+		std::string screen;
+		for(const auto& row : rows)
+		{
+			if(!row.second.empty())
+				screen += "  " + std::to_string(row.first) + "\t" + row.second + "\n";
+		}
+
+		if(hostPrintScreens && screen != shown)
+		{
+			::printf("screen at %u ms\n%s", (unsigned)(hostMicros() / 1000), screen.c_str());
+			shown = screen;
+		}
+	}
+
+private:
+	std::string shown;
+};
\ No newline at end of file
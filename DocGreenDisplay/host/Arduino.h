@@ -0,0 +1,405 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "host.h"
+#include "binary.h"
+
+// Arduino core of the host build, the sketch is built as if it ran on an
+// ESP32, the other ESP32 headers in this directory only contain what the
+// sketch uses.
+#define ARDUINO_ARCH_ESP32 1
+#define DOCGREEN_HOST 1
+
+#define PROGMEM
+#define PSTR(x) (x)
+typedef const char *PGM_P;
+#define pgm_read_byte(x) (*(const uint8_t *)(x))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define SERIAL_8N1 0x800001c
+#define ADC_11db 3
+#define DEC 10
+#define HEX 16
+
+// glibc only has it since 2.38
+static inline size_t hostStrlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+	if(size > 0)
+	{
+		size_t copy = len < size - 1 ? len : size - 1;
+		memcpy(dst, src, copy);
+		dst[copy] = 0;
+	}
+	return len;
+}
+#define strlcpy hostStrlcpy
+
+//
+// String
+//
+
+class String
+{
+public:
+	String() {}
+	String(const char *str) : str(str != NULL ? str : "") {}
+	String(const std::string& str) : str(str) {}
+	String(char c) : str(1, c) {}
+	String(int val, int base = DEC) : str(format(val, base)) {}
+	String(unsigned val, int base = DEC) : str(format(val, base)) {}
+	String(long val, int base = DEC) : str(format(val, base)) {}
+	String(unsigned long val, int base = DEC) : str(format(val, base)) {}
+	String(bool val) : str(val ? "1" : "0") {}
+	String(double val, int decimals = 2)
+	{
+		char buff[32];
+		snprintf(buff, sizeof(buff), "%.*f", decimals, val);
+		str = buff;
+	}
+
+	const char *c_str() const { return str.c_str(); }
+	size_t length() const { return str.size(); }
+	char operator[](size_t i) const { return str[i]; }
+
+	bool operator==(const String& other) const { return str == other.str; }
+	bool operator!=(const String& other) const { return str != other.str; }
+	bool operator==(const char *other) const { return str == other; }
+	bool operator!=(const char *other) const { return str != other; }
+
+	String& operator+=(const String& other) { str += other.str; return *this; }
+	friend String operator+(const String& a, const String& b) { return String(a.str + b.str); }
+	friend String operator+(const String& a, const char *b) { return String(a.str + b); }
+	friend String operator+(const char *a, const String& b) { return String(a + b.str); }
+
+	bool startsWith(const String& prefix) const { return str.compare(0, prefix.str.size(), prefix.str) == 0; }
+	bool endsWith(const String& suffix) const
+	{
+		return str.size() >= suffix.str.size()
+			&& str.compare(str.size() - suffix.str.size(), suffix.str.size(), suffix.str) == 0;
+	}
+	int indexOf(char c) const
+	{
+		size_t pos = str.find(c);
+		return pos == std::string::npos ? -1 : (int)pos;
+	}
+	String substring(size_t from) const { return str.substr(std::min(from, str.size())); }
+	String substring(size_t from, size_t to) const { return substring(from).str.substr(0, to - from); }
+	long toInt() const { return atol(str.c_str()); }
+	void reserve(size_t size) { str.reserve(size); }
+
+private:
+	std::string str;
+
+	static std::string format(long long val, int base)
+	{
+		char buff[72];
+		if(base == 16)
+			snprintf(buff, sizeof(buff), "%llx", val);
+		else
+			snprintf(buff, sizeof(buff), "%lld", val);
+		return buff;
+	}
+};
+
+//
+// Print and Stream
+//
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t val) = 0;
+	virtual size_t write(const uint8_t *data, size_t len)
+	{
+		size_t done = 0;
+		while(done < len && write(data[done]))
+			done++;
+		return done;
+	}
+	size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+	size_t write(const char *data, size_t len) { return write((const uint8_t *)data, len); }
+
+	size_t print(const char *str) { return write(str); }
+	size_t print(const String& str) { return write(str.c_str()); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(int val, int base = DEC) { return print(String(val, base)); }
+	size_t print(unsigned val, int base = DEC) { return print(String(val, base)); }
+	size_t print(long val, int base = DEC) { return print(String(val, base)); }
+	size_t print(unsigned long val, int base = DEC) { return print(String(val, base)); }
+	size_t print(double val, int decimals = 2) { return print(String(val, decimals)); }
+
+	size_t println() { return write("\r\n"); }
+	template<typename T> size_t println(T val) { return print(val) + println(); }
+	template<typename T> size_t println(T val, int arg) { return print(val, arg) + println(); }
+
+	size_t printf(const char *format, ...)
+	{
+		char buff[256];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(buff, sizeof(buff), format, args);
+		va_end(args);
+		return write(buff);
+	}
+
+	virtual void flush() {}
+};
+
+class Stream: public Print
+{
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+
+	size_t readBytes(uint8_t *buff, size_t len)
+	{
+		size_t done = 0;
+		int val;
+		while(done < len && (val = read()) >= 0)
+			buff[done++] = val;
+		return done;
+	}
+	void setTimeout(unsigned long) {}
+};
+
+//
+// time and pins
+//
+
+static inline uint32_t micros()
+{
+	return hostMicros();
+}
+static inline uint32_t millis()
+{
+	return hostMicros() / 1000;
+}
+static inline void delay(uint32_t ms)
+{
+	hostSleep(ms * 1000ULL);
+}
+static inline void delayMicroseconds(uint32_t us)
+{
+	hostSleep(us);
+}
+static inline void yield()
+{
+	hostSleep(0);
+}
+
+static uint8_t hostPinOutputs[HOST_PIN_COUNT];
+
+static inline void pinMode(uint8_t, uint8_t) {}
+static inline int analogRead(uint8_t pin)
+{
+	return hostReadPin(pin);
+}
+static inline int digitalRead(uint8_t pin)
+{
+	return hostReadPin(pin) != 0 ? HIGH : LOW;
+}
+static inline void digitalWrite(uint8_t pin, uint8_t val)
+{
+	if(pin < HOST_PIN_COUNT)
+		hostPinOutputs[pin] = val;
+}
+static inline void analogReadResolution(uint8_t) {}
+static inline void analogSetAttenuation(uint8_t) {}
+
+static inline long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+	return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+//
+// serial ports, Serial prints to stdout, Serial2 (the bus) is a tty given on
+// the command line, e.g. the pty of the ControllerSimulator
+//
+
+// intervals between input frames (address 25 and 27) sent on the bus
+typedef struct
+{
+	uint32_t frames;
+	uint64_t last; // virtual micros of the last 0x55
+	uint64_t minInterval;
+	uint64_t maxInterval;
+	double sum;
+	double sumSquared;
+} host_bus_stats_t;
+
+static host_bus_stats_t hostBusStats = {0, 0, UINT64_MAX, 0, 0, 0};
+static const char *hostBusPath = NULL;
+
+class HardwareSerial: public Stream
+{
+public:
+	HardwareSerial(int fd, bool isBus) : fd(fd), isBus(isBus) {}
+
+	// the bus is opened on hostBusPath, if given
+	void begin(unsigned long, uint32_t = SERIAL_8N1, int8_t = -1, int8_t = -1)
+	{
+		if(fd >= 0 || hostBusPath == NULL)
+			return;
+
+		fd = open(hostBusPath, O_RDWR | O_NOCTTY | O_NONBLOCK);
+		struct termios tio;
+		if(fd < 0 || tcgetattr(fd, &tio) != 0)
+		{
+			perror(hostBusPath);
+			exit(1);
+		}
+		cfmakeraw(&tio);
+		cfsetspeed(&tio, B115200);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+
+	int available() override
+	{
+		fill();
+		return rxLength - rxPos;
+	}
+	int read() override
+	{
+		fill();
+		return rxPos < rxLength ? rxBuff[rxPos++] : -1;
+	}
+
+	using Print::write;
+	size_t write(uint8_t val) override
+	{
+		return write(&val, 1);
+	}
+	size_t write(const uint8_t *data, size_t len) override
+	{
+		// stdio keeps the order with the output of the host
+		if(!isBus)
+			return fwrite(data, 1, len, stdout);
+
+		for(size_t i = 0; i < len; i++)
+			trackFrame(data[i]);
+		if(fd < 0)
+			return len; // nothing connected
+
+		size_t done = 0;
+		while(done < len)
+		{
+			ssize_t ret = ::write(fd, data + done, len - done);
+			if(ret < 0 && errno != EAGAIN)
+				break;
+			done += ret > 0 ? ret : 0;
+		}
+		return done;
+	}
+
+private:
+	int fd;
+	bool isBus;
+	uint8_t rxBuff[256];
+	int rxPos = 0;
+	int rxLength = 0;
+	uint8_t txPos = 0; // bytes of the current frame sent, starting with 55 AA
+	uint64_t txStart;
+
+	void fill()
+	{
+		if(fd < 0 || rxPos < rxLength || !isBus)
+			return;
+
+		ssize_t len = ::read(fd, rxBuff, sizeof(rxBuff));
+		rxPos = 0;
+		rxLength = len > 0 ? len : 0;
+	}
+
+	void trackFrame(uint8_t val)
+	{
+		if(val == 0x55 && txPos != 1)
+		{
+			txPos = 1;
+			txStart = hostMicros();
+			return;
+		}
+		else if(txPos == 0 || (txPos == 1 && val != 0xAA))
+		{
+			txPos = 0;
+			return;
+		}
+
+		txPos++;
+		if(txPos == 4 && (val == 0x25 || val == 0x27))
+		{
+			host_bus_stats_t& stats = hostBusStats;
+			if(stats.frames > 0)
+			{
+				uint64_t interval = txStart - stats.last;
+				stats.minInterval = std::min(stats.minInterval, interval);
+				stats.maxInterval = std::max(stats.maxInterval, interval);
+				stats.sum += interval;
+				stats.sumSquared += (double)interval * interval;
+			}
+			stats.frames++;
+			stats.last = txStart;
+		}
+		if(txPos >= 4)
+			txPos = 0;
+	}
+};
+
+static HardwareSerial Serial(STDOUT_FILENO, false);
+static HardwareSerial Serial2(-1, true);
+
+//
+// ESP32 specifics
+//
+
+static uint64_t hostRandomState = 1;
+
+static inline uint32_t esp_random()
+{
+	// xorshift64, seeded on the command line so runs are reproducible
+	hostRandomState ^= hostRandomState << 13;
+	hostRandomState ^= hostRandomState >> 7;
+	hostRandomState ^= hostRandomState << 17;
+	return hostRandomState >> 32;
+}
+
+class EspClass
+{
+public:
+	uint64_t getEfuseMac() { return 0x0000A1B2C3D4E5F6ULL; }
+	// there is no heap limit on the host, this is the typical value of the
+	// dashboard with WiFi and BLE running
+	uint32_t getFreeHeap() { return 100000; }
+	uint32_t getMinFreeHeap() { return 100000; }
+	String getSketchMD5() { return "00000000000000000000000000000000"; }
+	void restart()
+	{
+		fflush(stdout);
+		_exit(0);
+	}
+};
+static EspClass ESP;
+
+static inline void configTime(long, int, const char *, const char * = NULL, const char * = NULL) {}
+
+#include <freertos/FreeRTOS.h>
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <string>
+
+// BLE stack without a radio, no client ever connects. Everything the
+// dashboard uses is declared here, the other BLE headers include this one.
+
+class BLEUUID
+{
+public:
+	BLEUUID(uint16_t) {}
+	BLEUUID(const char *) {}
+};
+
+class BLEDescriptor {};
+
+class BLE2902: public BLEDescriptor
+{
+public:
+	bool getNotifications() { return false; }
+};
+
+class BLECharacteristic;
+
+class BLECharacteristicCallbacks
+{
+public:
+	virtual ~BLECharacteristicCallbacks() {}
+	virtual void onWrite(BLECharacteristic *characteristic) {}
+};
+
+class BLECharacteristic
+{
+public:
+	static const uint32_t PROPERTY_READ = 1 << 0;
+	static const uint32_t PROPERTY_WRITE = 1 << 1;
+	static const uint32_t PROPERTY_NOTIFY = 1 << 2;
+	static const uint32_t PROPERTY_WRITE_NR = 1 << 5;
+
+	std::string getValue() { return value; }
+	void setValue(uint8_t *data, size_t len) { value.assign((const char *)data, len); }
+	void notify() {}
+	void addDescriptor(BLEDescriptor *) {}
+	void setCallbacks(BLECharacteristicCallbacks *) {}
+
+private:
+	std::string value;
+};
+
+class BLEService
+{
+public:
+	BLECharacteristic *createCharacteristic(const char *, uint32_t) { return new BLECharacteristic(); }
+	void start() {}
+};
+
+class BLEServer;
+
+class BLEServerCallbacks
+{
+public:
+	virtual ~BLEServerCallbacks() {}
+	virtual void onConnect(BLEServer *) {}
+	virtual void onDisconnect(BLEServer *) {}
+};
+
+class BLEServer
+{
+public:
+	BLEService *createService(const char *) { return new BLEService(); }
+	void setCallbacks(BLEServerCallbacks *) {}
+	uint32_t getConnectedCount() { return 0; }
+	uint16_t getConnId() { return 0; }
+	uint16_t getPeerMTU(uint16_t) { return 23; }
+	void startAdvertising() {}
+};
+
+class BLEAdvertising
+{
+public:
+	void addServiceUUID(const char *) {}
+	void setScanResponse(bool) {}
+	void setMinPreferred(uint16_t) {}
+};
+
+class BLEDevice
+{
+public:
+	static void init(const char *) {}
+	static int setMTU(uint16_t) { return 0; }
+	static BLEServer *createServer() { return new BLEServer(); }
+	static BLEAdvertising *getAdvertising()
+	{
+		static BLEAdvertising advertising;
+		return &advertising;
+	}
+	static void startAdvertising() {}
+};
\ No newline at end of file
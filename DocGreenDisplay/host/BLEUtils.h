@@ -0,0 +1,2 @@
+#pragma once
+#include "BLEDevice.h"
\ No newline at end of file
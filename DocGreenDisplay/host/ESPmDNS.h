@@ -0,0 +1,9 @@
+#pragma once
+
+class MDNSResponder
+{
+public:
+	bool begin(const char *) { return true; }
+	void addService(const char *, const char *, int) {}
+};
+static MDNSResponder MDNS;
\ No newline at end of file
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <WiFi.h>
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_NOT_MODIFIED 304
+#define HTTP_CODE_NOT_FOUND 404
+
+// the host has no TLS, firmware downloads fail with "invalid URL"
+class HTTPClient
+{
+public:
+	bool begin(WiFiClient&, const String&) { return false; }
+	void end() {}
+	void addHeader(const String&, const String&) {}
+	int GET() { return -1; }
+	int getSize() { return -1; }
+	WiFiClient *getStreamPtr() { return NULL; }
+};
\ No newline at end of file
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// NVS replacement, all namespaces share one map which is written to
+// hostPreferencesPath (if set) on every change, one "<namespace>/<key> <hex>"
+// line per key.
+
+static std::map<std::string, std::vector<uint8_t>> hostPreferences;
+static const char *hostPreferencesPath = NULL;
+
+static void hostLoadPreferences(const char *path)
+{
+	hostPreferencesPath = path;
+	FILE *fd = fopen(path, "r");
+	if(fd == NULL)
+		return; // created on the first write
+
+	char key[64];
+	char hex[1024];
+	while(fscanf(fd, "%63s %1023s", key, hex) == 2)
+	{
+		std::vector<uint8_t>& val = hostPreferences[key];
+		for(size_t i = 0; hex[i] != 0 && hex[i + 1] != 0; i += 2)
+		{
+			unsigned byte;
+			sscanf(hex + i, "%2x", &byte);
+			val.push_back(byte);
+		}
+	}
+	fclose(fd);
+}
+
+static void hostSavePreferences()
+{
+	if(hostPreferencesPath == NULL)
+		return;
+
+	FILE *fd = fopen(hostPreferencesPath, "w");
+	if(fd == NULL)
+	{
+		perror(hostPreferencesPath);
+		return;
+	}
+
+	for(const auto& entry : hostPreferences)
+	{
+		fprintf(fd, "%s ", entry.first.c_str());
+		for(uint8_t byte : entry.second)
+			fprintf(fd, "%02x", byte);
+		// an empty value still needs a token
+		fprintf(fd, entry.second.empty() ? "-\n" : "\n");
+	}
+	fclose(fd);
+}
+
+class Preferences
+{
+public:
+	bool begin(const char *name, bool readOnly = false)
+	{
+		prefix = std::string(name) + "/";
+		return true;
+	}
+	void end() {}
+
+	bool isKey(const char *key)
+	{
+		return hostPreferences.count(prefix + key) != 0;
+	}
+	bool remove(const char *key)
+	{
+		bool found = hostPreferences.erase(prefix + key) != 0;
+		hostSavePreferences();
+		return found;
+	}
+
+	size_t getBytesLength(const char *key)
+	{
+		auto it = hostPreferences.find(prefix + key);
+		return it == hostPreferences.end() ? 0 : it->second.size();
+	}
+	size_t getBytes(const char *key, void *buff, size_t len)
+	{
+		auto it = hostPreferences.find(prefix + key);
+		if(it == hostPreferences.end() || it->second.size() > len)
+			return 0;
+
+		memcpy(buff, it->second.data(), it->second.size());
+		return it->second.size();
+	}
+	size_t putBytes(const char *key, const void *data, size_t len)
+	{
+		const uint8_t *bytes = (const uint8_t *)data;
+		hostPreferences[prefix + key].assign(bytes, bytes + len);
+		hostSavePreferences();
+		return len;
+	}
+
+	uint8_t getUChar(const char *key, uint8_t defaultValue = 0)
+	{
+		uint8_t val;
+		return getBytes(key, &val, 1) == 1 ? val : defaultValue;
+	}
+	size_t putUChar(const char *key, uint8_t val)
+	{
+		return putBytes(key, &val, 1);
+	}
+
+	uint32_t getUInt(const char *key, uint32_t defaultValue = 0)
+	{
+		uint32_t val;
+		return getBytes(key, &val, 4) == 4 ? val : defaultValue;
+	}
+	size_t putUInt(const char *key, uint32_t val)
+	{
+		return putBytes(key, &val, 4);
+	}
+
+	String getString(const char *key, String defaultValue = String())
+	{
+		auto it = hostPreferences.find(prefix + key);
+		if(it == hostPreferences.end())
+			return defaultValue;
+		return String(std::string(it->second.begin(), it->second.end()));
+	}
+	size_t putString(const char *key, String val)
+	{
+		return putBytes(key, val.c_str(), val.length());
+	}
+
+private:
+	std::string prefix;
+};
\ No newline at end of file
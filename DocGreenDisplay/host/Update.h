@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <vector>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+// keeps the written image in memory, end() reports its size instead of
+// switching the boot partition
+class UpdateClass
+{
+public:
+	bool begin(size_t size = UPDATE_SIZE_UNKNOWN)
+	{
+		image.clear();
+		expectedSize = size;
+		running = true;
+		return true;
+	}
+	size_t write(uint8_t *data, size_t len)
+	{
+		image.insert(image.end(), data, data + len);
+		return len;
+	}
+	bool end(bool evenIfRemaining = false)
+	{
+		running = false;
+		if(expectedSize != UPDATE_SIZE_UNKNOWN && image.size() != expectedSize && !evenIfRemaining)
+		{
+			error = "size mismatch";
+			return false;
+		}
+
+		printf("host: firmware image of %zu bytes written\n", image.size());
+		error = "";
+		return true;
+	}
+	void abort()
+	{
+		running = false;
+		image.clear();
+	}
+	bool isRunning() { return running; }
+	const char *errorString() { return error; }
+
+private:
+	std::vector<uint8_t> image;
+	size_t expectedSize;
+	bool running = false;
+	const char *error = "";
+};
+static UpdateClass Update;
\ No newline at end of file
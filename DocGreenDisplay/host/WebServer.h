@@ -0,0 +1,506 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include <strings.h>
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The parts of the ESP32 WebServer used by the dashboard on a real socket.
+// One request per connection, like the ESP32 after "Connection: close".
+// Requests are read completely before the handler runs, uploads are then
+// passed to the upload handler in HTTP_UPLOAD_BUFLEN chunks.
+
+enum HTTPMethod
+{
+	HTTP_ANY,
+	HTTP_GET,
+	HTTP_POST,
+	HTTP_PUT,
+};
+
+enum HTTPUploadStatus
+{
+	UPLOAD_FILE_START,
+	UPLOAD_FILE_WRITE,
+	UPLOAD_FILE_END,
+	UPLOAD_FILE_ABORTED,
+};
+
+#define HTTP_UPLOAD_BUFLEN 1436
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
+// requests with larger bodies are rejected
+#define HOST_MAX_REQUEST (8 * 1024 * 1024)
+
+typedef struct
+{
+	HTTPUploadStatus status;
+	String filename;
+	String name;
+	String type;
+	size_t totalSize;
+	size_t currentSize;
+	uint8_t buf[HTTP_UPLOAD_BUFLEN];
+} HTTPUpload;
+
+class WebServer
+{
+public:
+	typedef std::function<void(void)> THandlerFunction;
+
+	WebServer(int port = 80) : listener(port) {}
+
+	void begin()
+	{
+		listener.begin();
+	}
+
+	void on(const String& path, THandlerFunction handler)
+	{
+		on(path, HTTP_ANY, handler);
+	}
+	void on(const String& path, HTTPMethod method, THandlerFunction handler,
+		THandlerFunction uploadHandler = nullptr)
+	{
+		routes.push_back({path.c_str(), method, handler, uploadHandler});
+	}
+	void onNotFound(THandlerFunction handler)
+	{
+		notFoundHandler = handler;
+	}
+
+	void collectHeaders(const char **names, size_t count)
+	{
+		collected.clear();
+		for(size_t i = 0; i < count; i++)
+			collected.push_back({names[i], ""});
+	}
+
+	void handleClient()
+	{
+		current = listener.available();
+		if(!current)
+			return;
+
+		if(readRequest())
+			dispatch();
+
+		current.stop();
+	}
+
+	//
+	// request
+	//
+
+	String uri() { return path; }
+	HTTPMethod method() { return requestMethod; }
+	HTTPUpload& upload() { return currentUpload; }
+	WiFiClient client() { return current; }
+
+	String pathArg(unsigned i)
+	{
+		return i < pathArgs.size() ? String(pathArgs[i]) : String();
+	}
+
+	int args() { return requestArgs.size(); }
+	String argName(int i) { return String(requestArgs[i].first); }
+	String arg(int i) { return String(requestArgs[i].second); }
+	String arg(const String& name)
+	{
+		for(const auto& entry : requestArgs)
+		{
+			if(name == entry.first.c_str())
+				return String(entry.second);
+		}
+		return String();
+	}
+	bool hasArg(const String& name)
+	{
+		for(const auto& entry : requestArgs)
+		{
+			if(name == entry.first.c_str())
+				return true;
+		}
+		return false;
+	}
+
+	String header(const String& name)
+	{
+		for(const auto& entry : collected)
+		{
+			if(strcasecmp(entry.first.c_str(), name.c_str()) == 0)
+				return String(entry.second);
+		}
+		return String();
+	}
+	bool hasHeader(const String& name)
+	{
+		return header(name).length() > 0;
+	}
+
+	//
+	// response
+	//
+
+	void sendHeader(const String& name, const String& value, bool first = false)
+	{
+		std::string line = std::string(name.c_str()) + ": " + value.c_str() + "\r\n";
+		if(first)
+			responseHeaders.insert(0, line);
+		else
+			responseHeaders += line;
+	}
+	void setContentLength(size_t len)
+	{
+		contentLength = len;
+	}
+
+	void send(int code, const char *type = NULL, const String& content = String())
+	{
+		send(code, type, content.c_str(), content.length());
+	}
+	void send(int code, const String& type, const String& content)
+	{
+		send(code, type.c_str(), content.c_str(), content.length());
+	}
+	void send(int code, const char *type, const char *content, size_t len)
+	{
+		if(contentLength == CONTENT_LENGTH_NOT_SET)
+			contentLength = len;
+		sendResponseHeader(code, type);
+		sendContent(content, len);
+	}
+	void send_P(int code, PGM_P type, PGM_P content)
+	{
+		send(code, type, content, strlen(content));
+	}
+	void send_P(int code, PGM_P type, PGM_P content, size_t len)
+	{
+		send(code, type, content, len);
+	}
+
+	void sendContent(const String& content)
+	{
+		sendContent(content.c_str(), content.length());
+	}
+	void sendContent(const char *content, size_t len)
+	{
+		current.write((const uint8_t *)content, len);
+	}
+
+private:
+	typedef struct
+	{
+		std::string path; // "{}" matches one path segment
+		HTTPMethod method;
+		THandlerFunction handler;
+		THandlerFunction uploadHandler;
+	} route_t;
+
+	WiFiServer listener;
+	WiFiClient current;
+	std::vector<route_t> routes;
+	THandlerFunction notFoundHandler;
+	std::vector<std::pair<std::string, std::string>> collected;
+
+	HTTPMethod requestMethod;
+	String path;
+	std::string contentType;
+	std::string body;
+	std::vector<std::string> pathArgs;
+	std::vector<std::pair<std::string, std::string>> requestArgs;
+	HTTPUpload currentUpload;
+
+	std::string responseHeaders;
+	size_t contentLength;
+
+	static int hexDigit(char c)
+	{
+		if(c >= '0' && c <= '9')
+			return c - '0';
+		c |= 0x20;
+		return c >= 'a' && c <= 'f' ? c - 'a' + 10 : 0;
+	}
+
+	static std::string urlDecode(const std::string& str)
+	{
+		std::string decoded;
+		for(size_t i = 0; i < str.size(); i++)
+		{
+			if(str[i] == '+')
+				decoded += ' ';
+			else if(str[i] == '%' && i + 2 < str.size())
+			{
+				decoded += (char)(hexDigit(str[i + 1]) << 4 | hexDigit(str[i + 2]));
+				i += 2;
+			}
+			else
+				decoded += str[i];
+		}
+		return decoded;
+	}
+
+	void parseArgs(const std::string& query)
+	{
+		size_t pos = 0;
+		while(pos < query.size())
+		{
+			size_t end = query.find('&', pos);
+			if(end == std::string::npos)
+				end = query.size();
+
+			std::string entry = query.substr(pos, end - pos);
+			size_t equals = entry.find('=');
+			if(!entry.empty())
+			{
+				if(equals == std::string::npos)
+					requestArgs.push_back({urlDecode(entry), ""});
+				else
+					requestArgs.push_back({urlDecode(entry.substr(0, equals)), urlDecode(entry.substr(equals + 1))});
+			}
+			pos = end + 1;
+		}
+	}
+
+	// appends whatever arrived, up to max bytes
+	bool readSome(std::string& buff, size_t max)
+	{
+		char chunk[4096];
+		ssize_t ret = recv(current.fd(), chunk, std::min(sizeof(chunk), max), 0);
+		if(ret <= 0)
+			return false;
+		buff.append(chunk, ret);
+		return true;
+	}
+
+	// reads until buff holds len bytes
+	bool readBytes(std::string& buff, size_t len)
+	{
+		while(buff.size() < len)
+		{
+			if(!readSome(buff, len - buff.size()))
+				return false;
+		}
+		return true;
+	}
+
+	bool readRequest()
+	{
+		std::string head;
+		size_t end;
+		while((end = head.find("\r\n\r\n")) == std::string::npos)
+		{
+			if(head.size() > 16384 || !readSome(head, 4096))
+				return false;
+		}
+		body = head.substr(end + 4);
+		head.resize(end + 2);
+
+		requestArgs.clear();
+		pathArgs.clear();
+		contentType.clear();
+		responseHeaders.clear();
+		contentLength = CONTENT_LENGTH_NOT_SET;
+		for(auto& entry : collected)
+			entry.second.clear();
+
+		size_t lineEnd = head.find("\r\n");
+		std::string line = head.substr(0, lineEnd);
+		size_t space1 = line.find(' ');
+		size_t space2 = line.find(' ', space1 + 1);
+		if(space1 == std::string::npos || space2 == std::string::npos)
+			return false;
+
+		std::string methodName = line.substr(0, space1);
+		if(methodName == "POST")
+			requestMethod = HTTP_POST;
+		else if(methodName == "PUT")
+			requestMethod = HTTP_PUT;
+		else
+			requestMethod = HTTP_GET;
+
+		std::string target = line.substr(space1 + 1, space2 - space1 - 1);
+		size_t query = target.find('?');
+		path = urlDecode(target.substr(0, query)).c_str();
+		if(query != std::string::npos)
+			parseArgs(target.substr(query + 1));
+
+		size_t bodyLength = 0;
+		for(size_t pos = lineEnd + 2; pos < head.size(); )
+		{
+			lineEnd = head.find("\r\n", pos);
+			line = head.substr(pos, lineEnd - pos);
+			pos = lineEnd + 2;
+
+			size_t colon = line.find(':');
+			if(colon == std::string::npos)
+				continue;
+			std::string name = line.substr(0, colon);
+			std::string value = line.substr(line.find_first_not_of(' ', colon + 1) == std::string::npos
+				? line.size() : line.find_first_not_of(' ', colon + 1));
+
+			if(strcasecmp(name.c_str(), "Content-Length") == 0)
+				bodyLength = strtoul(value.c_str(), NULL, 10);
+			else if(strcasecmp(name.c_str(), "Content-Type") == 0)
+				contentType = value;
+
+			for(auto& entry : collected)
+			{
+				if(strcasecmp(entry.first.c_str(), name.c_str()) == 0)
+					entry.second = value;
+			}
+		}
+
+		if(bodyLength > HOST_MAX_REQUEST)
+			return false;
+		if(!readBytes(body, bodyLength))
+			return false;
+		body.resize(bodyLength);
+
+		if(contentType.compare(0, 33, "application/x-www-form-urlencoded") == 0)
+			parseArgs(body);
+		else if(!body.empty() && contentType.compare(0, 19, "multipart/form-data") != 0)
+			requestArgs.push_back({"plain", body});
+		return true;
+	}
+
+	bool matchRoute(const route_t& route)
+	{
+		if(route.method != HTTP_ANY && route.method != requestMethod)
+			return false;
+
+		pathArgs.clear();
+		const char *pattern = route.path.c_str();
+		const char *str = path.c_str();
+		while(*pattern != 0)
+		{
+			if(pattern[0] == '{' && pattern[1] == '}')
+			{
+				const char *end = strchr(str, '/');
+				if(end == NULL)
+					end = str + strlen(str);
+				pathArgs.push_back(std::string(str, end));
+				str = end;
+				pattern += 2;
+			}
+			else if(*pattern++ != *str++)
+			{
+				return false;
+			}
+		}
+		return *str == 0;
+	}
+
+	void sendUpload(HTTPUploadStatus status, const char *data, size_t len, const route_t& route)
+	{
+		currentUpload.status = status;
+		currentUpload.currentSize = len;
+		memcpy(currentUpload.buf, data, len);
+		if(status == UPLOAD_FILE_WRITE)
+			currentUpload.totalSize += len;
+		route.uploadHandler();
+	}
+
+	// passes the file parts to the upload handler, the other parts become args
+	void parseMultipart(const route_t& route)
+	{
+		size_t boundaryPos = contentType.find("boundary=");
+		if(boundaryPos == std::string::npos)
+			return;
+		std::string boundary = "--" + contentType.substr(boundaryPos + 9);
+
+		size_t pos = body.find(boundary);
+		while(pos != std::string::npos)
+		{
+			pos += boundary.size();
+			if(body.compare(pos, 2, "--") == 0)
+				break;
+
+			size_t headEnd = body.find("\r\n\r\n", pos);
+			if(headEnd == std::string::npos)
+				break;
+			std::string head = body.substr(pos, headEnd - pos);
+			size_t dataStart = headEnd + 4;
+			size_t next = body.find("\r\n" + boundary, dataStart);
+			if(next == std::string::npos)
+				break;
+
+			std::string name, filename;
+			size_t namePos = head.find("name=\"");
+			if(namePos != std::string::npos)
+				name = head.substr(namePos + 6, head.find('"', namePos + 6) - namePos - 6);
+			size_t filenamePos = head.find("filename=\"");
+			if(filenamePos != std::string::npos)
+				filename = head.substr(filenamePos + 10, head.find('"', filenamePos + 10) - filenamePos - 10);
+
+			if(filenamePos == std::string::npos || !route.uploadHandler)
+			{
+				requestArgs.push_back({name, body.substr(dataStart, next - dataStart)});
+			}
+			else
+			{
+				currentUpload.name = name.c_str();
+				currentUpload.filename = filename.c_str();
+				currentUpload.totalSize = 0;
+				sendUpload(UPLOAD_FILE_START, NULL, 0, route);
+				for(size_t i = dataStart; i < next; i += HTTP_UPLOAD_BUFLEN)
+					sendUpload(UPLOAD_FILE_WRITE, body.data() + i, std::min((size_t)HTTP_UPLOAD_BUFLEN, next - i), route);
+				sendUpload(UPLOAD_FILE_END, NULL, 0, route);
+			}
+
+			pos = next + 2;
+		}
+	}
+
+	void dispatch()
+	{
+		for(const route_t& route : routes)
+		{
+			if(!matchRoute(route))
+				continue;
+
+			if(contentType.compare(0, 19, "multipart/form-data") == 0)
+				parseMultipart(route);
+			route.handler();
+			return;
+		}
+
+		if(notFoundHandler)
+			notFoundHandler();
+		else
+			send(404, "text/plain", "Not found");
+	}
+
+	static const char *statusText(int code)
+	{
+		switch(code)
+		{
+			case 200: return "OK";
+			case 304: return "Not Modified";
+			case 400: return "Bad Request";
+			case 404: return "Not Found";
+			case 409: return "Conflict";
+			case 500: return "Internal Server Error";
+			case 503: return "Service Unavailable";
+			default: return "";
+		}
+	}
+
+	void sendResponseHeader(int code, const char *type)
+	{
+		std::string head = "HTTP/1.1 " + std::to_string(code) + " " + statusText(code) + "\r\n";
+		if(type != NULL && type[0] != 0)
+			head += std::string("Content-Type: ") + type + "\r\n";
+		if(contentLength != CONTENT_LENGTH_UNKNOWN)
+			head += "Content-Length: " + std::to_string(contentLength) + "\r\n";
+		head += responseHeaders;
+		head += "Connection: close\r\n\r\n";
+		current.write((const uint8_t *)head.data(), head.size());
+	}
+};
\ No newline at end of file
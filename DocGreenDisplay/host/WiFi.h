@@ -0,0 +1,167 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include <memory>
+
+// No radio on the host, servers listen on 127.0.0.1 at their port plus
+// hostPortOffset, e.g. the webinterface at http://127.0.0.1:8080/.
+
+enum
+{
+	WIFI_OFF,
+	WIFI_STA,
+	WIFI_AP,
+	WIFI_AP_STA,
+};
+
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+static uint16_t hostPortOffset = 8000;
+
+class WiFiClass
+{
+public:
+	void persistent(bool) {}
+	void mode(int) {}
+	void disconnect() {}
+	void setHostname(const char *) {}
+	void begin(const char *, const char *) {}
+	void softAP(const char *, const char *) {}
+	int status() { return WL_DISCONNECTED; }
+};
+static WiFiClass WiFi;
+
+// copies share the socket, it is closed with the last copy or stop()
+class WiFiClient: public Stream
+{
+public:
+	WiFiClient() {}
+	WiFiClient(int fd) : socket(new int(fd), [](int *fd) {
+		if(*fd >= 0)
+			close(*fd);
+		delete fd;
+	}) {}
+
+	operator bool() { return socket != NULL && *socket >= 0; }
+
+	bool connected()
+	{
+		if(!*this)
+			return false;
+
+		uint8_t val;
+		ssize_t len = recv(*socket, &val, 1, MSG_PEEK | MSG_DONTWAIT);
+		return len > 0 || (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+	}
+
+	void stop()
+	{
+		if(*this)
+		{
+			close(*socket);
+			*socket = -1;
+		}
+		socket.reset();
+	}
+
+	int available() override
+	{
+		int len = 0;
+		if(!*this || ioctl(*socket, FIONREAD, &len) != 0)
+			return 0;
+		return len;
+	}
+
+	int read() override
+	{
+		uint8_t val;
+		if(!*this || recv(*socket, &val, 1, MSG_DONTWAIT) != 1)
+			return -1;
+		return val;
+	}
+
+	using Print::write;
+	size_t write(uint8_t val) override
+	{
+		return write(&val, 1);
+	}
+	size_t write(const uint8_t *data, size_t len) override
+	{
+		if(!*this)
+			return 0;
+
+		size_t done = 0;
+		while(done < len)
+		{
+			ssize_t ret = send(*socket, data + done, len - done, MSG_NOSIGNAL);
+			if(ret <= 0)
+				break;
+			done += ret;
+		}
+		return done;
+	}
+
+	void setNoDelay(bool enable)
+	{
+		int val = enable;
+		if(*this)
+			setsockopt(*socket, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+	}
+
+	int fd() const { return socket != NULL ? *socket : -1; }
+
+private:
+	std::shared_ptr<int> socket;
+};
+
+class WiFiServer
+{
+public:
+	WiFiServer(uint16_t port = 80) : port(port) {}
+
+	void begin()
+	{
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		int val = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+
+		struct sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port + hostPortOffset);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0)
+		{
+			fprintf(stderr, "host: port %u: %s\n", port + hostPortOffset, strerror(errno));
+			exit(1);
+		}
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+	}
+
+	WiFiClient available()
+	{
+		if(fd < 0)
+			return WiFiClient();
+
+		int client = accept(fd, NULL, NULL);
+		if(client < 0)
+			return WiFiClient();
+
+		// writes block like on the ESP32, but not forever
+		struct timeval timeout = {1, 0};
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		return WiFiClient(client);
+	}
+
+private:
+	uint16_t port;
+	int fd = -1;
+};
\ No newline at end of file
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <WiFi.h>
+
+// only used for downloads, which the host doesn't do (see HTTPClient.h)
+class WiFiClientSecure: public WiFiClient
+{
+public:
+	void setCACert(const char *) {}
+};
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <Arduino.h>
+
+class TwoWire
+{
+public:
+	TwoWire(int bus) {}
+	bool begin(int sda, int scl, uint32_t frequency) { return true; }
+};
+static TwoWire Wire(0);
\ No newline at end of file
@@ -0,0 +1,140 @@
+// Benchmarks the status serializer (serializer.hpp) on the host: the bytes per
+// second of full and delta JSON and of the binary encoding, and the heap
+// allocations per call, which have to be zero.
+//
+// build (in DocGreenDisplay):
+//   g++ -O2 -std=gnu++17 -I host -o bench-serializer host/bench-serializer.cpp
+// usage: ./bench-serializer [iterations]
+//
+// Allocations are counted by replacing malloc and friends (operator new ends
+// up in malloc as well), the exit code is 1 if any call allocated.
+
+#include <chrono>
+
+#include <Arduino.h>
+#include "../serializer.hpp"
+
+// receivePacket of protocol.h feeds the sniffer, which isn't linked here
+void snifferByte(uint8_t) {}
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static size_t benchAllocations = 0;
+
+extern "C" void *malloc(size_t size)
+{
+	benchAllocations++;
+	return __libc_malloc(size);
+}
+extern "C" void *calloc(size_t count, size_t size)
+{
+	benchAllocations++;
+	return __libc_calloc(count, size);
+}
+extern "C" void *realloc(void *ptr, size_t size)
+{
+	benchAllocations++;
+	return __libc_realloc(ptr, size);
+}
+
+#define BENCH_STATUS_COUNT 256
+
+// statuses of a ride, every frame changes only a few fields like on the bus
+static docgreen_status_t benchStatuses[BENCH_STATUS_COUNT];
+
+static void benchGenerateStatuses()
+{
+	docgreen_status_t status;
+	memset(&status, 0, sizeof(status));
+	status.soc = 87;
+	status.voltage = 4020;
+	status.odometer = 123456;
+	status.mainboardVersion = 0x0136;
+
+	for(int i = 0; i < BENCH_STATUS_COUNT; i++)
+	{
+		status.throttle = 0x2C + (i * 7) % 0xA0;
+		status.speed = i * 37 % 25000;
+		status.current = (i * 113) % 1500 - 300;
+		status.timeSinceBoot = i / 4;
+		if(i % 16 == 0)
+			status.voltage--;
+		if(i % 64 == 0)
+			status.lights = !status.lights;
+
+		benchStatuses[i] = status;
+	}
+}
+
+typedef struct
+{
+	const char *name;
+	size_t bytes;
+	size_t calls;
+	size_t allocations;
+	double seconds;
+} bench_result_t;
+
+template<typename F>
+static bench_result_t benchRun(const char *name, int iterations, F serialize)
+{
+	bench_result_t result = {name, 0, 0, 0, 0};
+	auto start = std::chrono::steady_clock::now();
+	size_t allocations = benchAllocations;
+
+	for(int i = 0; i < iterations; i++)
+	{
+		for(int j = 0; j < BENCH_STATUS_COUNT; j++)
+			result.bytes += serialize(benchStatuses[j], benchStatuses[(j + BENCH_STATUS_COUNT - 1) % BENCH_STATUS_COUNT]);
+		result.calls += BENCH_STATUS_COUNT;
+	}
+
+	result.allocations = benchAllocations - allocations;
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+	benchGenerateStatuses();
+
+	static char json[STATUS_JSON_MAX_LENGTH];
+	static uint8_t binary[STATUS_BINARY_MAX_LENGTH];
+	bench_result_t results[] = {
+		benchRun("json full", iterations, [](const docgreen_status_t& status, const docgreen_status_t&) {
+			json_writer_t writer;
+			jsonBegin(writer, json, sizeof(json));
+			serializeStatusJson(writer, status);
+			return jsonEnd(writer);
+		}),
+		benchRun("json delta", iterations, [](const docgreen_status_t& status, const docgreen_status_t& last) {
+			json_writer_t writer;
+			jsonBegin(writer, json, sizeof(json));
+			serializeStatusJson(writer, status, statusFieldsChanged(status, last));
+			return jsonEnd(writer);
+		}),
+		benchRun("binary full", iterations, [](const docgreen_status_t& status, const docgreen_status_t&) {
+			return serializeStatusBinary(binary, sizeof(binary), status);
+		}),
+		benchRun("binary delta", iterations, [](const docgreen_status_t& status, const docgreen_status_t& last) {
+			return serializeStatusBinary(binary, sizeof(binary), status, statusFieldsChanged(status, last));
+		}),
+	};
+
+	bool allocated = false;
+	::printf("%-14s %10s %12s %10s %12s\n", "", "bytes/call", "MB/s", "ns/call", "allocs/call");
+	for(const bench_result_t& result : results)
+	{
+		::printf("%-14s %10.1f %12.1f %10.1f %12.3f\n", result.name,
+			(double)result.bytes / result.calls,
+			result.bytes / result.seconds / 1e6,
+			result.seconds * 1e9 / result.calls,
+			(double)result.allocations / result.calls);
+		allocated |= result.allocations != 0;
+	}
+
+	return allocated ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,4 @@
+#pragma once
+
+// esp_random() is in Arduino.h
+#include <Arduino.h>
\ No newline at end of file
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <deque>
+#include <vector>
+
+#include "../host.h"
+
+// FreeRTOS on the scheduler of host.h, one tick is one millisecond. Only one
+// task runs at a time, so critical sections need no locking.
+
+typedef void *TaskHandle_t;
+typedef void *QueueHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffff
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskIDLE_PRIORITY 0
+
+//
+// tasks, stack size, priority and core are ignored
+//
+
+static inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+	uint32_t, void *arg, UBaseType_t, TaskHandle_t *handle, BaseType_t)
+{
+	if(handle != NULL)
+		*handle = (TaskHandle_t)name;
+	return hostTaskCreate(fn, name, arg) ? pdPASS : pdFAIL;
+}
+
+static inline BaseType_t xTaskCreate(TaskFunction_t fn, const char *name,
+	uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+	return xTaskCreatePinnedToCore(fn, name, stack, arg, priority, handle, 0);
+}
+
+// only deleting the calling task is supported
+static inline void vTaskDelete(TaskHandle_t)
+{
+	hostTaskExit();
+}
+
+static inline void vTaskDelay(TickType_t ticks)
+{
+	hostSleep(ticks * 1000ULL);
+}
+
+static inline uint32_t xPortGetCoreID()
+{
+	return 0;
+}
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+//
+// mutexes, any timeout but 0 waits forever
+//
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+	return new host_mutex_t{NULL};
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks)
+{
+	return hostMutexTake((host_mutex_t *)mutex, ticks != 0) ? pdTRUE : pdFALSE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+	hostMutexGive((host_mutex_t *)mutex);
+	return pdTRUE;
+}
+
+//
+// queues, sending to a full or receiving from an empty queue never waits
+//
+
+typedef struct
+{
+	UBaseType_t length;
+	UBaseType_t itemSize;
+	std::deque<std::vector<uint8_t>> items;
+} host_queue_t;
+
+static inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+	return new host_queue_t{length, itemSize, {}};
+}
+
+static inline BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t)
+{
+	host_queue_t *queue = (host_queue_t *)handle;
+	if(queue->items.size() >= queue->length)
+		return pdFALSE;
+
+	const uint8_t *data = (const uint8_t *)item;
+	queue->items.emplace_back(data, data + queue->itemSize);
+	return pdTRUE;
+}
+
+static inline BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t)
+{
+	host_queue_t *queue = (host_queue_t *)handle;
+	if(queue->items.empty())
+		return pdFALSE;
+
+	memcpy(item, queue->items.front().data(), queue->itemSize);
+	queue->items.pop_front();
+	return pdTRUE;
+}
+
+static inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle)
+{
+	return ((host_queue_t *)handle)->items.size();
+}
\ No newline at end of file
@@ -0,0 +1,293 @@
+// Fuzz target and replay driver for the M365 request handling (m365.hpp),
+// which parses whatever a BLE client writes into the RX characteristic.
+//
+// libFuzzer (in DocGreenDisplay):
+//   clang++ -g -O1 -std=gnu++17 -fsanitize=fuzzer,address,undefined -DM365_LIBFUZZER -I host -o fuzz-m365 host/fuzz-m365.cpp
+// replay with g++ (in DocGreenDisplay), drop the sanitizers to measure requests/s:
+//   g++ -g -O1 -std=gnu++17 -fsanitize=address,undefined -I host -o fuzz-m365 host/fuzz-m365.cpp
+// usage: ./fuzz-m365 [-n count] [-S seed] [session...]
+//
+// A session file has one request per line as hex bytes, e.g. the app polling
+// the telemetry "55 AA 03 20 01 B0 16 15 FF", # starts a comment. Without
+// files a built-in session of the usual app requests is used. The replay
+// runs the sessions, then count random and mutated requests, and prints the
+// requests per second.
+//
+// The first byte of a fuzz input selects the transport: bits 0-6 are the
+// maximum payload (from the MTU), bit 7 enables the write commands. Unless
+// the input is shorter than 3 bytes, the length and checksum of the request
+// in the remaining bytes are fixed up, so mutations reach the commands.
+// Every response is checked for its framing, checksum and payload size.
+
+#include <chrono>
+
+#include <Arduino.h>
+#include "../m365.hpp"
+
+// the parts of the sketch m365.hpp uses
+scooter_settings_t settings;
+void snifferByte(uint8_t) {}
+
+static uint32_t fuzzQueuedCommands = 0;
+bool queueBusCommand(bus_command_type_t, uint8_t)
+{
+	fuzzQueuedCommands++;
+	return true;
+}
+
+static uint8_t fuzzMaxPayload;
+static uint32_t fuzzResponses = 0;
+
+static void fuzzCheck(bool condition, const char *message, const uint8_t *data, uint8_t len)
+{
+	if(condition)
+		return;
+
+	fprintf(stderr, "invalid response, %s:", message);
+	for(uint8_t i = 0; i < len; i++)
+		fprintf(stderr, " %02X", data[i]);
+	fprintf(stderr, "\n");
+	abort();
+}
+
+static void fuzzSend(const uint8_t *data, uint8_t len)
+{
+	fuzzCheck(len >= 8, "too short", data, len);
+	fuzzCheck(data[0] == 0x55 && data[1] == 0xAA, "no header", data, len);
+	fuzzCheck(data[2] + 6 == len, "length mismatch", data, len);
+
+	// register reads fit the transport, writes are acknowledged with 0 or 1
+	if(data[4] == 0x01)
+		fuzzCheck(len - 8 <= fuzzMaxPayload, "payload exceeds the transport", data, len);
+	else
+		fuzzCheck(data[4] == 0x02 && len == 9 && data[6] <= 1, "unexpected response", data, len);
+
+	uint16_t checksum = data[len - 2] | (data[len - 1] << 8);
+	fuzzCheck(calculateChecksum((uint8_t *)data + 2) == checksum, "bad checksum", data, len);
+	fuzzResponses++;
+}
+
+// bytes after 55 AA are length, address, command, offset and payload
+static void fuzzFixRequest(uint8_t *data, size_t len)
+{
+	data[0] = 0x55;
+	data[1] = 0xAA;
+	data[2] = len - 6;
+	uint16_t checksum = calculateChecksum(data + 2);
+	data[len - 2] = checksum & 0xFF;
+	data[len - 1] = checksum >> 8;
+}
+
+static void fuzzRequest(uint8_t config, const uint8_t *data, size_t len, bool fix)
+{
+	// requests come from a single BLE write, so they never exceed 255 bytes
+	uint8_t request[255];
+	if(len > sizeof(request))
+		len = sizeof(request);
+	memcpy(request, data, len);
+	if(fix && len >= 8)
+		fuzzFixRequest(request, len);
+
+	fuzzMaxPayload = config & 0x7F;
+	settings.bleControlEnable = (config & 0x80) != 0;
+	m365_transport_t transport = {fuzzSend, fuzzMaxPayload};
+	m365HandleRequest(transport, request, len);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static bool initialized = false;
+	if(!initialized)
+	{
+		m365Setup();
+		initialized = true;
+	}
+
+	if(size < 1)
+		return 0;
+
+	fuzzRequest(data[0], data + 1, size - 1, size >= 3);
+	return 0;
+}
+
+#ifndef M365_LIBFUZZER
+
+#include <vector>
+#include <string>
+
+typedef std::vector<uint8_t> fuzz_request_t;
+
+// what the apps poll and write
+static const char *fuzzBuiltinSession[] = {
+	"55 AA 03 20 01 10 0E BD FF", // serial number
+	"55 AA 03 20 01 1A 02 BF FF", // firmware version
+	"55 AA 03 20 01 B0 16 15 FF", // telemetry block, as far as the registers go
+	"55 AA 03 20 01 25 02 B4 FF", // range
+	"55 AA 03 20 01 3A 04 9D FF", // trip time
+	"55 AA 04 20 03 7D 02 00 59 FF", // lights on
+	"55 AA 04 20 03 70 01 00 67 FF", // lock
+	"55 AA 04 20 03 71 01 00 66 FF", // unlock
+	"55 AA 04 20 02 75 01 00 63 FF", // eco mode with response
+};
+
+static bool fuzzParseLine(const std::string& line, fuzz_request_t& request)
+{
+	request.clear();
+	size_t end = line.find('#');
+	std::string hex = line.substr(0, end);
+
+	size_t pos = 0;
+	while(pos < hex.size())
+	{
+		if(isspace((unsigned char)hex[pos]))
+		{
+			pos++;
+			continue;
+		}
+
+		char *next;
+		long val = strtol(hex.c_str() + pos, &next, 16);
+		if(next == hex.c_str() + pos || val < 0 || val > 0xFF)
+			return false;
+
+		request.push_back(val);
+		pos = next - hex.c_str();
+	}
+	return true;
+}
+
+static bool fuzzLoadSession(const char *path, std::vector<fuzz_request_t>& requests)
+{
+	FILE *fd = fopen(path, "r");
+	if(fd == NULL)
+	{
+		perror(path);
+		return false;
+	}
+
+	char line[1024];
+	int lineNumber = 0;
+	fuzz_request_t request;
+	while(fgets(line, sizeof(line), fd) != NULL)
+	{
+		lineNumber++;
+		if(!fuzzParseLine(line, request))
+		{
+			fprintf(stderr, "%s:%d: invalid hex\n", path, lineNumber);
+			fclose(fd);
+			return false;
+		}
+		if(!request.empty())
+			requests.push_back(request);
+	}
+
+	fclose(fd);
+	return true;
+}
+
+static uint64_t fuzzRandomState = 1;
+static uint32_t fuzzRandom()
+{
+	// xorshift64 like esp_random() of the host shim
+	fuzzRandomState ^= fuzzRandomState << 13;
+	fuzzRandomState ^= fuzzRandomState >> 7;
+	fuzzRandomState ^= fuzzRandomState << 17;
+	return fuzzRandomState >> 32;
+}
+
+// a request of the recorded ones with random lengths, offsets and commands,
+// or flipped bits
+static void fuzzMutate(const std::vector<fuzz_request_t>& requests, fuzz_request_t& request)
+{
+	request = requests[fuzzRandom() % requests.size()];
+	switch(fuzzRandom() % 4)
+	{
+		case 0: // offset and read length
+			if(request.size() >= 8)
+			{
+				request[5] = fuzzRandom();
+				request[6] = fuzzRandom();
+			}
+			break;
+		case 1: // command
+			if(request.size() >= 8)
+				request[4] = fuzzRandom() % 8;
+			break;
+		case 2: // length, appended bytes are random
+		{
+			size_t oldSize = request.size();
+			request.resize(fuzzRandom() % 256);
+			for(size_t i = oldSize; i < request.size(); i++)
+				request[i] = fuzzRandom();
+			break;
+		}
+		default: // bits anywhere
+			for(int i = fuzzRandom() % 4; i >= 0 && !request.empty(); i--)
+				request[fuzzRandom() % request.size()] ^= 1 << (fuzzRandom() % 8);
+			break;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	long count = 1000000;
+	std::vector<fuzz_request_t> requests;
+
+	int opt;
+	while((opt = getopt(argc, argv, "n:S:")) != -1)
+	{
+		if(opt == 'n')
+			count = atol(optarg);
+		else if(opt == 'S')
+			fuzzRandomState = strtoull(optarg, NULL, 0) | 1;
+		else
+		{
+			fprintf(stderr, "usage: %s [-n count] [-S seed] [session...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	for(int i = optind; i < argc; i++)
+	{
+		if(!fuzzLoadSession(argv[i], requests))
+			return 1;
+	}
+	if(requests.empty())
+	{
+		fuzz_request_t request;
+		for(const char *line : fuzzBuiltinSession)
+		{
+			fuzzParseLine(line, request);
+			requests.push_back(request);
+		}
+	}
+
+	m365Setup();
+	auto start = std::chrono::steady_clock::now();
+
+	// the sessions as recorded, with the usual MTUs and writes enabled
+	const uint8_t payloads[] = {12, 20, 64, 127};
+	for(uint8_t payload : payloads)
+	{
+		for(const fuzz_request_t& request : requests)
+			fuzzRequest(0x80 | payload, request.data(), request.size(), false);
+	}
+	uint32_t replayResponses = fuzzResponses;
+
+	fuzz_request_t request;
+	for(long i = 0; i < count; i++)
+	{
+		fuzzMutate(requests, request);
+		fuzzRequest(fuzzRandom(), request.data(), request.size(), fuzzRandom() % 4 != 0);
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	long total = count + sizeof(payloads) * requests.size();
+	::printf("%zu recorded requests, %u responses\n", requests.size() * sizeof(payloads), replayResponses);
+	::printf("%ld mutated requests, %u responses, %u bus commands\n", count,
+		fuzzResponses - replayResponses, fuzzQueuedCommands);
+	::printf("%.0f requests/s\n", total / seconds);
+	return 0;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,117 @@
+// Runs the whole DocGreenDisplay sketch as a Linux process on a virtual clock,
+// e.g. to measure the timing of the main loop while the webserver is loaded.
+//
+// build (in DocGreenDisplay):
+//   cd webinterface && python3 generate-bundle.py && cd ..
+//   g++ -O2 -std=gnu++17 -I host -o dashboard-host host/host-main.cpp -lpthread
+// usage: ./dashboard-host [-s serial] [-t factor] [-k scale] [-d duration]
+//            [-p preferences] [-i inputs] [-P port offset] [-S seed] [-o]
+//
+// The headers in this directory replace the ESP32 core and libraries (see
+// host.h for the scheduler). Tasks run one at a time and only delay() and
+// friends advance the virtual clock, so a run only depends on its inputs.
+//
+// -s opens the bus UART on a tty, e.g. the pty of the ControllerSimulator.
+//    As the simulator runs in real time, use the same -t for both.
+// -t runs the virtual clock factor times faster than real time, by default
+//    it runs as fast as possible.
+// -k charges scale times the CPU time of the host to the virtual clock, so
+//    slow code delays the other tasks like on the ESP32 (roughly 10-50).
+// -d stops after the given virtual milliseconds, default is until SIGINT.
+// -p keeps the preferences in a file, by default they start empty.
+// -i reads "<ms> <pin> <value>" lines setting analog and digital inputs, e.g.
+//    "1000 39 700" opens the throttle after a second.
+// -P serves the webinterface (port 80) etc. on 127.0.0.1 at port + offset,
+//    default is 8000.
+// -S seeds esp_random(), which generates the WiFi password.
+// -o prints the display whenever it changes.
+//
+// At the end the intervals between input frames sent on the bus are printed.
+
+#include <signal.h>
+
+#include "../DocGreenDisplay.ino"
+
+static volatile sig_atomic_t hostStopped = 0;
+
+static void hostStop(int)
+{
+	hostStopped = 1;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t duration = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "s:t:k:d:p:i:P:S:o")) != -1)
+	{
+		switch(opt)
+		{
+			case 's':
+				hostBusPath = optarg;
+				break;
+			case 't':
+				hostRealtimeFactor = atof(optarg);
+				break;
+			case 'k':
+				hostCpuScale = atof(optarg);
+				break;
+			case 'd':
+				duration = strtoull(optarg, NULL, 10);
+				break;
+			case 'p':
+				hostLoadPreferences(optarg);
+				break;
+			case 'i':
+				if(!hostLoadInputs(optarg))
+					return 1;
+				break;
+			case 'P':
+				hostPortOffset = atoi(optarg);
+				break;
+			case 'S':
+				hostRandomState = strtoull(optarg, NULL, 0) | 1;
+				break;
+			case 'o':
+				hostPrintScreens = true;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-s serial] [-t factor] [-k scale] [-d duration] "
+					"[-p preferences] [-i inputs] [-P port offset] [-S seed] [-o]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	signal(SIGINT, hostStop);
+	signal(SIGTERM, hostStop);
+	signal(SIGPIPE, SIG_IGN);
+
+	uint64_t loops = 0;
+	hostStart();
+	setup();
+	while(!hostStopped && (duration == 0 || hostMicros() < duration * 1000))
+	{
+		loop();
+		loops++;
+	}
+
+	host_bus_stats_t& stats = hostBusStats;
+	printf("%.3f s virtual time, %llu loops, %u screen updates\n", hostMicros() / 1e6,
+		(unsigned long long)loops, hostScreenUpdates);
+	if(stats.frames > 1)
+	{
+		double mean = stats.sum / (stats.frames - 1);
+		double variance = stats.sumSquared / (stats.frames - 1) - mean * mean;
+		printf("%u input frames, interval min %.3f ms, max %.3f ms, mean %.3f ms, stddev %.3f ms\n",
+			stats.frames, stats.minInterval / 1e3, stats.maxInterval / 1e3, mean / 1e3,
+			sqrt(variance > 0 ? variance : 0) / 1e3);
+	}
+	else
+	{
+		printf("%u input frames\n", stats.frames);
+	}
+
+	// the other tasks are waiting for the CPU forever
+	fflush(stdout);
+	_exit(0);
+}
\ No newline at end of file
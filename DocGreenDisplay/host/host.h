@@ -0,0 +1,267 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Virtual clock and scheduler of the host build (see host-main.cpp).
+//
+// Every FreeRTOS task is a thread, but only the one holding the CPU runs.
+// Tasks give it away in delay(), vTaskDelay() and when blocking on a mutex,
+// the task with the earliest wake time runs next and the clock jumps to that
+// time. Code thus takes no virtual time unless hostCpuScale charges the host
+// CPU time of a task, and runs are deterministic as long as their inputs are.
+
+typedef struct
+{
+	const char *name;
+	uint64_t wake; // virtual micros
+	uint64_t order; // first come first serve between equal wake times
+	const void *blockedOn; // semaphore the task waits for
+	bool finished;
+} host_task_t;
+
+struct host_task_exit_t {};
+
+static std::mutex hostLock;
+static std::condition_variable hostWakeup;
+static std::vector<host_task_t *> hostTasks;
+static host_task_t *hostCurrent = NULL;
+static thread_local host_task_t *hostSelf = NULL;
+static uint64_t hostNow = 0;
+static uint64_t hostOrder = 0;
+
+// 0 runs as fast as possible, otherwise the virtual clock runs factor times
+// faster than the real one, e.g. to talk to the ControllerSimulator
+static double hostRealtimeFactor = 0;
+// >0 charges scale times the host CPU time of a task to the virtual clock
+static double hostCpuScale = 0;
+static double hostRealStart;
+static uint64_t hostSliceCpu;
+
+static uint64_t hostThreadCpu()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static double hostRealTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// CPU time of the running task since it got the CPU, in virtual micros
+static uint64_t hostSliceCharge()
+{
+	if(hostCpuScale <= 0)
+		return 0;
+	return (hostThreadCpu() - hostSliceCpu) * hostCpuScale;
+}
+
+static uint64_t hostMicros()
+{
+	return hostNow + hostSliceCharge();
+}
+
+static host_task_t *hostNextTask()
+{
+	host_task_t *next = NULL;
+	for(host_task_t *task : hostTasks)
+	{
+		if(task->finished || task->blockedOn != NULL)
+			continue;
+		if(next == NULL || task->wake < next->wake
+			|| (task->wake == next->wake && task->order < next->order))
+			next = task;
+	}
+	return next;
+}
+
+// gives the CPU to the next task, returns once the calling task runs again
+static void hostSwitch(std::unique_lock<std::mutex>& lock)
+{
+	hostNow += hostSliceCharge();
+
+	host_task_t *next = hostNextTask();
+	if(next == NULL)
+	{
+		fprintf(stderr, "host: all tasks are blocked at %llu us\n", (unsigned long long)hostNow);
+		fflush(stdout);
+		_exit(1);
+	}
+
+	if(next->wake > hostNow)
+	{
+		hostNow = next->wake;
+		if(hostRealtimeFactor > 0)
+		{
+			double wait = hostRealStart + hostNow / 1e6 / hostRealtimeFactor - hostRealTime();
+			if(wait > 0)
+				std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+		}
+	}
+
+	hostCurrent = next;
+	hostWakeup.notify_all();
+	if(hostSelf->finished)
+		return;
+
+	hostWakeup.wait(lock, [] { return hostCurrent == hostSelf; });
+	hostSliceCpu = hostThreadCpu();
+}
+
+static void hostSleep(uint64_t us)
+{
+	std::unique_lock<std::mutex> lock(hostLock);
+	hostSelf->wake = hostMicros() + us;
+	hostSelf->order = hostOrder++;
+	hostSwitch(lock);
+}
+
+// called by the thread running setup() and loop()
+static void hostStart()
+{
+	host_task_t *task = new host_task_t{"loop", 0, hostOrder++, NULL, false};
+	hostTasks.push_back(task);
+	hostSelf = task;
+	hostCurrent = task;
+	hostRealStart = hostRealTime();
+	hostSliceCpu = hostThreadCpu();
+}
+
+static bool hostTaskCreate(void (*fn)(void *), const char *name, void *arg)
+{
+	std::unique_lock<std::mutex> lock(hostLock);
+	host_task_t *task = new host_task_t{name, hostMicros(), hostOrder++, NULL, false};
+	hostTasks.push_back(task);
+
+	std::thread([fn, arg, task]() {
+		std::unique_lock<std::mutex> lock(hostLock);
+		hostSelf = task;
+		hostWakeup.wait(lock, [] { return hostCurrent == hostSelf; });
+		hostSliceCpu = hostThreadCpu();
+		lock.unlock();
+
+		try
+		{
+			fn(arg);
+		}
+		catch(host_task_exit_t&)
+		{
+		}
+
+		lock.lock();
+		task->finished = true;
+		hostSwitch(lock);
+	}).detach();
+	return true;
+}
+
+// ends the calling task, FreeRTOS tasks must not return
+[[noreturn]] static void hostTaskExit()
+{
+	throw host_task_exit_t();
+}
+
+//
+// mutex semaphores, tasks waiting for them don't run until they are given
+//
+
+typedef struct
+{
+	host_task_t *owner;
+} host_mutex_t;
+
+static bool hostMutexTake(host_mutex_t *mutex, bool wait)
+{
+	std::unique_lock<std::mutex> lock(hostLock);
+	while(mutex->owner != NULL)
+	{
+		if(!wait)
+			return false;
+
+		hostSelf->blockedOn = mutex;
+		hostSelf->order = hostOrder++;
+		hostSwitch(lock);
+	}
+
+	mutex->owner = hostSelf;
+	return true;
+}
+
+static void hostMutexGive(host_mutex_t *mutex)
+{
+	std::unique_lock<std::mutex> lock(hostLock);
+	mutex->owner = NULL;
+	for(host_task_t *task : hostTasks)
+	{
+		if(task->blockedOn != mutex)
+			continue;
+		task->blockedOn = NULL;
+		task->wake = std::max(task->wake, hostMicros());
+	}
+}
+
+//
+// inputs
+//
+
+#define HOST_PIN_COUNT 40
+
+typedef struct
+{
+	uint64_t time; // virtual micros
+	uint8_t pin;
+	uint16_t value;
+} host_input_t;
+
+static uint16_t hostPins[HOST_PIN_COUNT];
+static std::vector<host_input_t> hostInputs;
+static size_t hostNextInput = 0;
+
+// lines of "<ms> <pin> <value>" set analog and digital inputs at a virtual time
+static bool hostLoadInputs(const char *path)
+{
+	FILE *fd = fopen(path, "r");
+	if(fd == NULL)
+	{
+		perror(path);
+		return false;
+	}
+
+	unsigned long time;
+	unsigned pin, value;
+	while(fscanf(fd, "%lu %u %u", &time, &pin, &value) == 3)
+	{
+		if(pin < HOST_PIN_COUNT)
+			hostInputs.push_back({time * 1000ULL, (uint8_t)pin, (uint16_t)value});
+	}
+	fclose(fd);
+
+	std::stable_sort(hostInputs.begin(), hostInputs.end(), [](const host_input_t& a, const host_input_t& b) {
+		return a.time < b.time;
+	});
+	return true;
+}
+
+static uint16_t hostReadPin(uint8_t pin)
+{
+	uint64_t now = hostMicros();
+	while(hostNextInput < hostInputs.size() && hostInputs[hostNextInput].time <= now)
+	{
+		hostPins[hostInputs[hostNextInput].pin] = hostInputs[hostNextInput].value;
+		hostNextInput++;
+	}
+
+	return pin < HOST_PIN_COUNT ? hostPins[pin] : 0;
+}
\ No newline at end of file
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
+#include "config.h"
 #include "state.hpp"
 
 typedef struct
@@ -16,6 +19,37 @@ typedef struct
 
 static_assert(sizeof(scooter_logentry_t) == 4, "Logentry size does not fit.");
 
+// one sample of the long-term history, either a single second or the mean of a minute
+typedef struct
+{
+	uint32_t speed : 9; // speed in 0.1 km/h (max = 512 -> 51.2km/h)
+	uint32_t voltage : 9; // voltage in 0.1 V (max = 512 -> 51.2V)
+	int32_t current : 10; // current in 0.1 A (-51.2A to 51.1A)
+	uint32_t lights : 1;
+	uint32_t ecoMode : 1;
+	uint32_t locked : 1;
+	uint32_t gap : 1; // no status was received in this second/minute
+} scooter_history_sample_t;
+
+static_assert(sizeof(scooter_history_sample_t) == 4, "History sample size does not fit.");
+
+// hourly rollup of the long-term history, same units as scooter_history_sample_t
+typedef struct
+{
+	uint32_t speedMin : 9;
+	uint32_t speedMax : 9;
+	uint32_t speedMean : 9;
+	uint32_t gap : 1; // no status was received in this hour
+	uint32_t voltageMin : 9;
+	uint32_t voltageMax : 9;
+	uint32_t voltageMean : 9;
+	int32_t currentMin : 10;
+	int32_t currentMax : 10;
+	int32_t currentMean : 10;
+} scooter_history_rollup_t;
+
+static_assert(sizeof(scooter_history_rollup_t) == 12, "History rollup size does not fit.");
+
 static scooter_logentry_t logEntries[1024];
 static uint16_t logPos = 0;
 static uint32_t odometerAtStart = 0;
@@ -45,3 +79,268 @@ void loggingLoop()
 
 	logPos++;
 }
+
+
+//
+// long-term history
+//
+// The history is kept in three fixed size ring buffers with decreasing
+// resolution. All of them are fed incrementally from the same accumulators,
+// thus the memory footprint stays the same no matter how long we are running.
+//
+// Every entry covers one time slot, slots without any status become gap
+// entries, so the time of an entry follows from its distance to the newest.
+// Seconds and minutes count from boot and are lost at power off. Hours count
+// hours of operation and are stored in NVS when finished, the running hour
+// is lost at power off.
+//
+
+typedef struct
+{
+	int32_t sum;
+	int16_t min;
+	int16_t max;
+} history_metric_t;
+
+typedef struct
+{
+	history_metric_t speed;
+	history_metric_t voltage;
+	history_metric_t current;
+	uint32_t count;
+} history_accumulator_t;
+
+template<typename T, uint16_t N>
+struct history_ring_t
+{
+	T entries[N];
+	uint16_t pos; // index of the next entry to write
+	uint16_t count;
+	uint32_t lastTime; // tier-specific time index (second/minute/hour) of the newest entry
+
+	void append(const T& entry)
+	{
+		entries[pos] = entry;
+		pos = pos + 1 >= N ? 0 : pos + 1;
+		if(count < N)
+			count++;
+	}
+
+	// returns the number of entries written, including gap entries
+	uint16_t push(const T& entry, uint32_t time)
+	{
+		uint16_t written = 1;
+		if(count > 0 && time > lastTime + 1)
+		{
+			T gap;
+			memset(&gap, 0, sizeof(gap));
+			gap.gap = 1;
+
+			uint32_t missing = time - lastTime - 1;
+			for(uint32_t i = 0; i < missing && i < N - 1; i++, written++)
+				append(gap);
+		}
+
+		append(entry);
+		lastTime = time;
+		return written;
+	}
+};
+
+static history_ring_t<scooter_history_sample_t, HISTORY_SECONDS> historySeconds;
+static history_ring_t<scooter_history_sample_t, HISTORY_MINUTES> historyMinutes;
+static history_ring_t<scooter_history_rollup_t, HISTORY_HOURS> historyHours;
+
+static_assert(HISTORY_HOURS % HISTORY_HOURS_CHUNK == 0 && HISTORY_HOURS / HISTORY_HOURS_CHUNK <= 32,
+	"History hours have to be split into at most 32 chunks.");
+
+#define HISTORY_VERSION 1
+#define HISTORY_META_KEY "hist-meta"
+
+typedef struct
+{
+	uint8_t version;
+	uint16_t pos;
+	uint16_t count;
+	uint32_t lastTime;
+} history_meta_t;
+
+static uint32_t historyHourBase = 0; // hours of operation before this boot
+static uint32_t historyHoursDirty = 0; // chunks not yet written to NVS
+
+static history_accumulator_t historySecondAcc;
+static history_accumulator_t historyMinuteAcc;
+static history_accumulator_t historyHourAcc;
+
+static void historyAccumulate(history_metric_t& metric, int16_t val, bool first)
+{
+	if(first)
+	{
+		metric.sum = 0;
+		metric.min = val;
+		metric.max = val;
+	}
+
+	metric.sum += val;
+	if(val < metric.min)
+		metric.min = val;
+	if(val > metric.max)
+		metric.max = val;
+}
+
+static void historyAccumulate(history_accumulator_t& acc, int16_t speed, int16_t voltage, int16_t current)
+{
+	bool first = acc.count == 0;
+	historyAccumulate(acc.speed, speed, first);
+	historyAccumulate(acc.voltage, voltage, first);
+	historyAccumulate(acc.current, current, first);
+	acc.count++;
+}
+
+static int16_t historyMean(const history_metric_t& metric, uint32_t count)
+{
+	return metric.sum / (int32_t)count;
+}
+
+static scooter_history_sample_t historyFinishSample(history_accumulator_t& acc)
+{
+	scooter_history_sample_t sample;
+	sample.speed = historyMean(acc.speed, acc.count);
+	sample.voltage = historyMean(acc.voltage, acc.count);
+	sample.current = historyMean(acc.current, acc.count);
+	sample.lights = scooterStatus.lights;
+	sample.ecoMode = scooterStatus.ecoMode;
+	sample.locked = isLocked;
+	sample.gap = 0;
+
+	acc.count = 0;
+	return sample;
+}
+
+static scooter_history_rollup_t historyFinishRollup(history_accumulator_t& acc)
+{
+	scooter_history_rollup_t rollup;
+	rollup.speedMin = acc.speed.min;
+	rollup.speedMax = acc.speed.max;
+	rollup.speedMean = historyMean(acc.speed, acc.count);
+	rollup.gap = 0;
+	rollup.voltageMin = acc.voltage.min;
+	rollup.voltageMax = acc.voltage.max;
+	rollup.voltageMean = historyMean(acc.voltage, acc.count);
+	rollup.currentMin = acc.current.min;
+	rollup.currentMax = acc.current.max;
+	rollup.currentMean = historyMean(acc.current, acc.count);
+
+	acc.count = 0;
+	return rollup;
+}
+
+static int16_t historyClamp(int32_t val, int16_t min, int16_t max)
+{
+	if(val < min)
+		return min;
+	if(val > max)
+		return max;
+	return val;
+}
+
+static void historyChunkKey(char *key, size_t size, uint8_t chunk)
+{
+	snprintf(key, size, "hist-h%u", chunk);
+}
+
+// reads the hours of earlier boots, call after preferences.begin
+void historyLoad()
+{
+	history_meta_t meta;
+	if(preferences.getBytes(HISTORY_META_KEY, &meta, sizeof(meta)) != sizeof(meta)
+		|| meta.version != HISTORY_VERSION || meta.pos >= HISTORY_HOURS || meta.count > HISTORY_HOURS)
+		return;
+
+	for(uint8_t i = 0; i < HISTORY_HOURS / HISTORY_HOURS_CHUNK; i++)
+	{
+		char key[16];
+		historyChunkKey(key, sizeof(key), i);
+
+		// a missing chunk leaves gap entries instead of garbage
+		scooter_history_rollup_t *chunk = &historyHours.entries[i * HISTORY_HOURS_CHUNK];
+		size_t size = HISTORY_HOURS_CHUNK * sizeof(scooter_history_rollup_t);
+		if(preferences.getBytes(key, chunk, size) != size)
+		{
+			memset(chunk, 0, size);
+			for(uint16_t j = 0; j < HISTORY_HOURS_CHUNK; j++)
+				chunk[j].gap = 1;
+		}
+	}
+
+	historyHours.pos = meta.pos;
+	historyHours.count = meta.count;
+	historyHours.lastTime = meta.lastTime;
+	if(meta.count > 0)
+		historyHourBase = meta.lastTime + 1;
+}
+
+// writes finished hours to NVS, called from the main loop after releasing
+// stateMutex as the flash write takes a while
+void historySave()
+{
+	if(historyHoursDirty == 0)
+		return;
+
+	for(uint8_t i = 0; i < HISTORY_HOURS / HISTORY_HOURS_CHUNK; i++)
+	{
+		if((historyHoursDirty & (1UL << i)) == 0)
+			continue;
+
+		char key[16];
+		historyChunkKey(key, sizeof(key), i);
+		preferences.putBytes(key, &historyHours.entries[i * HISTORY_HOURS_CHUNK],
+			HISTORY_HOURS_CHUNK * sizeof(scooter_history_rollup_t));
+	}
+
+	history_meta_t meta;
+	memset(&meta, 0, sizeof(meta));
+	meta.version = HISTORY_VERSION;
+	meta.pos = historyHours.pos;
+	meta.count = historyHours.count;
+	meta.lastTime = historyHours.lastTime;
+	preferences.putBytes(HISTORY_META_KEY, &meta, sizeof(meta));
+
+	historyHoursDirty = 0;
+}
+
+static void historyPushHour(const scooter_history_rollup_t& rollup, uint32_t hour)
+{
+	uint16_t start = historyHours.pos;
+	uint16_t written = historyHours.push(rollup, hour);
+	for(uint16_t i = 0; i < written; i++)
+		historyHoursDirty |= 1UL << ((start + i) % HISTORY_HOURS / HISTORY_HOURS_CHUNK);
+}
+
+// called for every status update received from the motor controller
+void historyUpdate(docgreen_status_t& status)
+{
+	uint32_t second = millis() / 1000;
+	uint32_t minute = second / 60;
+	uint32_t hour = historyHourBase + minute / 60;
+
+	// finish the entries of all tiers whose time slot has passed
+	static uint32_t currentSecond = 0;
+	uint32_t currentHour = historyHourBase + currentSecond / 3600;
+	if(second != currentSecond && historySecondAcc.count > 0)
+		historySeconds.push(historyFinishSample(historySecondAcc), currentSecond);
+	if(minute != currentSecond / 60 && historyMinuteAcc.count > 0)
+		historyMinutes.push(historyFinishSample(historyMinuteAcc), currentSecond / 60);
+	if(hour != currentHour && historyHourAcc.count > 0)
+		historyPushHour(historyFinishRollup(historyHourAcc), currentHour);
+	currentSecond = second;
+
+	// convert to the units of the history entries, see scooter_history_sample_t
+	int16_t speed = historyClamp(status.speed / 100, 0, 511);
+	int16_t voltage = historyClamp(status.voltage / 10, 0, 511);
+	int16_t current = historyClamp(status.current / 10, -512, 511);
+
+	historyAccumulate(historySecondAcc, speed, voltage, current);
+	historyAccumulate(historyMinuteAcc, speed, voltage, current);
+	historyAccumulate(historyHourAcc, speed, voltage, current);
+}
\ No newline at end of file
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "state.hpp"
+#include "protocol.h"
+#include "serializer.hpp"
+
+// Instead of implementing a custom protocol we emulate the orginal
+// M365 Bluetooth Protocol, hopefully this allows users to use one of the
+// many M365 apps available with this dashboard.
+// For an overview of the protocol see:
+//      https://github.com/etransport/ninebot-docs/wiki/protocol
+//      https://github.com/etransport/ninebot-docs/wiki/M365ESC
+//      https://github.com/etransport/py9b
+
+// This file only contains the register table and the request handling, the
+// BLE transport lives in bluetooth.hpp.
+
+#define M365_REG_MAGIC 0x00
+#define M365_REG_PIN 0x17
+#define M365_REG_ERROR 0x1B
+#define M365_REG_SOC 0x22
+#define M365_REG_RANGE_CONSERVATIVE 0x24
+#define M365_REG_RANGE 0x25
+#define M365_REG_SPEED1 0x26
+#define M365_REG_ODOMETER 0x29
+#define M365_REG_TRIP_ODOMETER 0x2F
+#define M365_REG_OPERATION_TIME 0x32
+#define M365_REG_OPERATION_TIME2 0x34
+#define M365_REG_TRIP_TIME 0x3A
+#define M365_REG_TRIP_TIME2 0x3B
+#define M365_REG_BATTERY_VOLTAGE 0x48
+#define M365_REG_AVERAGE_SPEED 0x65
+#define M365_REG_LOCK_COMMAND 0x70
+#define M365_REG_UNLOCK_COMMAND 0x71
+#define M365_REG_ECO_MODE 0x75
+#define M365_REG_LIGHTS 0x7D
+#define M365_REG_ERROR2 0xB0
+#define M365_REG_SOC2 0xB4
+#define M365_REG_SPEED2 0xB5
+#define M365_REG_AVERAGE_SPEED2 0xB6
+#define M365_REG_ODOMETER2 0xB7
+#define M365_REG_TRIP_ODOMETER2 0xB9
+
+#define M365_REGISTER_COUNT (M365_REG_TRIP_ODOMETER2 + 2)
+// the registers pushed to subscribed clients, the address is the one of
+// responses from the motor controller
+#define M365_TELEMETRY_START M365_REG_ERROR2
+#define M365_TELEMETRY_ADDRESS 0x23
+
+uint16_t m365Registers[M365_REGISTER_COUNT];
+// a bit for every register changed since the notify path last looked at it
+uint32_t m365DirtyRegisters[(M365_REGISTER_COUNT + 31) / 32];
+uint32_t tripStartOdometer = 0;
+uint32_t averageSpeedCount = 0;
+int32_t averageSpeed = 0;
+
+// Registers derived from docgreen_status_t. A register is only recomputed
+// when one of its source fields changed, its value is also stored in the
+// mirror register if there is one.
+typedef uint32_t (*m365_register_value_t)(const docgreen_status_t& status);
+typedef struct
+{
+	uint8_t reg;
+	uint8_t width; // in 16 bit registers
+	uint8_t mirror; // 0 if none
+	uint32_t sources; // STATUS_FIELD_BIT of the fields the value depends on
+	m365_register_value_t value;
+} m365_register_map_t;
+
+static const m365_register_map_t m365RegisterMap[] = {
+	{M365_REG_ERROR, 1, M365_REG_ERROR2, STATUS_FIELD_BIT(errorCode),
+		[](const docgreen_status_t& status) -> uint32_t { return status.errorCode; }},
+	{M365_REG_SOC, 1, M365_REG_SOC2, STATUS_FIELD_BIT(soc),
+		[](const docgreen_status_t& status) -> uint32_t { return status.soc; }},
+	// 20km = 20000m at 100% => 200m/%
+	{M365_REG_RANGE, 1, 0, STATUS_FIELD_BIT(soc),
+		[](const docgreen_status_t& status) -> uint32_t { return 20 * (uint32_t)status.soc; }},
+	// 16km = 16000m at 100% => 160m/%
+	{M365_REG_RANGE_CONSERVATIVE, 1, 0, STATUS_FIELD_BIT(soc),
+		[](const docgreen_status_t& status) -> uint32_t { return 16 * (uint32_t)status.soc; }},
+	{M365_REG_SPEED1, 1, M365_REG_SPEED2, STATUS_FIELD_BIT(speed),
+		[](const docgreen_status_t& status) -> uint32_t { return status.speed; }},
+	{M365_REG_ODOMETER, 2, M365_REG_ODOMETER2, STATUS_FIELD_BIT(odometer),
+		[](const docgreen_status_t& status) -> uint32_t { return status.odometer; }},
+	{M365_REG_TRIP_ODOMETER, 1, M365_REG_TRIP_ODOMETER2, STATUS_FIELD_BIT(odometer),
+		[](const docgreen_status_t& status) -> uint32_t { return status.odometer - tripStartOdometer; }},
+	{M365_REG_OPERATION_TIME, 2, M365_REG_OPERATION_TIME2, STATUS_FIELD_BIT(totalOperationTime),
+		[](const docgreen_status_t& status) -> uint32_t { return status.totalOperationTime; }},
+	{M365_REG_BATTERY_VOLTAGE, 1, 0, STATUS_FIELD_BIT(voltage),
+		[](const docgreen_status_t& status) -> uint32_t { return status.voltage; }},
+	{M365_REG_ECO_MODE, 1, 0, STATUS_FIELD_BIT(ecoMode),
+		[](const docgreen_status_t& status) -> uint32_t { return status.ecoMode; }},
+	{M365_REG_LIGHTS, 1, 0, STATUS_FIELD_BIT(lights),
+		[](const docgreen_status_t& status) -> uint32_t { return status.lights; }},
+};
+
+static docgreen_status_t m365LastStatus;
+static bool m365HasStatus = false;
+static uint32_t m365LastTripTime = 0;
+
+// how responses leave the device, provided by the transport
+typedef struct
+{
+	void (*send)(const uint8_t *data, uint8_t len);
+	uint8_t maxPayload; // largest register payload fitting into one message
+} m365_transport_t;
+
+// writes width registers and marks them dirty if the value changed
+void m365SetRegister(uint8_t offset, uint8_t width, uint32_t val)
+{
+	uint16_t words[2] = {(uint16_t)val, (uint16_t)(val >> 16)};
+	if(memcmp(&m365Registers[offset], words, width * 2) == 0)
+		return;
+
+	// registers are not necessarily 4 byte aligned
+	memcpy(&m365Registers[offset], words, width * 2);
+	for(uint8_t i = offset; i < offset + width; i++)
+		m365DirtyRegisters[i / 32] |= 1UL << (i % 32);
+}
+
+// returns whether any register in [start, end) changed and clears their dirty bits
+bool m365TakeDirty(uint8_t start, uint8_t end)
+{
+	bool dirty = false;
+	for(uint8_t i = start; i < end; i++)
+	{
+		if(m365DirtyRegisters[i / 32] & (1UL << (i % 32)))
+		{
+			dirty = true;
+			m365DirtyRegisters[i / 32] &= ~(1UL << (i % 32));
+		}
+	}
+	return dirty;
+}
+
+static void m365Send(const m365_transport_t& transport, uint8_t *response, uint8_t payloadLen)
+{
+	uint16_t checksum = calculateChecksum(response + 2);
+	response[payloadLen + 6] = checksum & 0xFF;
+	response[payloadLen + 7] = checksum >> 8;
+
+	transport.send(response, payloadLen + 8);
+}
+
+// answers a read of len bytes starting at register offset, with a large MTU
+// a whole block of registers fits into one notification. Larger reads are
+// split into several responses of whole registers, each with its own offset,
+// as if the client had read the parts one after another.
+void m365SendRegisters(const m365_transport_t& transport, uint8_t address, uint8_t offset, uint8_t len)
+{
+	// a transport not fitting a single register can't answer at all
+	uint8_t chunk = transport.maxPayload & ~1;
+	if(chunk == 0)
+		return;
+
+	do
+	{
+		uint8_t partLen = len > chunk ? chunk : len;
+		uint8_t response[8 + partLen];
+		response[0] = 0x55;
+		response[1] = 0xAA;
+		response[2] = partLen + 2; // packet length
+		response[3] = address;
+		response[4] = 0x01; // read register
+		response[5] = offset;
+		memcpy(response + 6, &m365Registers[offset], partLen);
+
+		m365Send(transport, response, partLen);
+		offset += partLen / 2;
+		len -= partLen;
+	} while(len > 0);
+}
+
+void m365HandleRequest(const m365_transport_t& transport, const uint8_t *buff, uint8_t len)
+{
+	if(len < 8 || len != buff[2] + 6)
+		return;
+
+	if(buff[0] != 0x55 || buff[1] != 0xaa)
+		return;
+
+	uint16_t actualChecksum = buff[len - 2] | (buff[len - 1] << 8);
+	if(calculateChecksum((uint8_t *)buff + 2) != actualChecksum)
+		return;
+
+#if 0
+	for(int i = 0; i < len; i++)
+	{
+		if(buff[i] < 16)
+			Serial.print('0');
+
+		Serial.print(buff[i], 16);
+		Serial.print(' ');
+	}
+	Serial.println();
+#endif
+
+	uint8_t cmd = buff[4];
+	uint8_t offset = buff[5];
+
+	if(cmd == 0x01) // read register
+	{
+		// offset is in 16 bit registers, the length in bytes
+		uint8_t readLen = buff[6];
+		if(offset >= M365_REGISTER_COUNT || readLen > (M365_REGISTER_COUNT - offset) * 2)
+			return;  // TODO send an error back?
+
+		m365SendRegisters(transport, buff[3] + 3, offset, readLen);
+	}
+	else if(cmd == 0x02 || cmd == 0x03) // write register
+	{
+		bool enabled = buff[6] != 0 || (len >= 10 && buff[7] != 0);
+		bool queued = false;
+
+		// the registers keep showing the state reported by the controller,
+		// the response only tells whether the command was accepted
+		if(!settings.bleControlEnable)
+			queued = false; // write disabled
+		else if(offset == M365_REG_LOCK_COMMAND)
+			queued = queueBusCommand(BUS_COMMAND_LOCK, true);
+		else if(offset == M365_REG_UNLOCK_COMMAND)
+			queued = queueBusCommand(BUS_COMMAND_LOCK, false);
+		else if(offset == M365_REG_ECO_MODE)
+			queued = queueBusCommand(BUS_COMMAND_ECO_MODE, enabled);
+		else if(offset == M365_REG_LIGHTS)
+			queued = queueBusCommand(BUS_COMMAND_LIGHT, enabled);
+
+		if(cmd == 0x03) // write without response
+			return;
+
+		uint8_t response[9];
+		response[0] = 0x55;
+		response[1] = 0xAA;
+		response[2] = 3; // packet length
+		response[3] = buff[3] + 3; // address
+		response[4] = cmd;
+		response[5] = offset;
+		response[6] = queued ? 1 : 0;
+		m365Send(transport, response, 1);
+	}
+}
+
+void m365Setup()
+{
+	m365SetRegister(M365_REG_MAGIC, 1, 0x515C);
+	memset(&m365Registers[M365_REG_PIN], '0', 6);
+}
+
+// called for every received packet, tripTime is in seconds
+void m365UpdateRegisters(const docgreen_status_t& status, uint32_t tripTime)
+{
+	if(tripStartOdometer == 0)
+		tripStartOdometer = status.odometer;
+
+	uint32_t changed = m365HasStatus ? statusFieldsChanged(status, m365LastStatus) : STATUS_FIELDS_ALL;
+	m365LastStatus = status;
+	m365HasStatus = true;
+
+	for(const m365_register_map_t& curr : m365RegisterMap)
+	{
+		if((changed & curr.sources) == 0)
+			continue;
+
+		uint32_t val = curr.value(status);
+		m365SetRegister(curr.reg, curr.width, val);
+		if(curr.mirror != 0)
+			m365SetRegister(curr.mirror, curr.width, val);
+	}
+
+	// the average is updated with every packet while driving, not only on changes
+	if(status.speed > 100)
+	{
+		averageSpeedCount++;
+		int32_t diff = (int32_t)status.speed * 1000 - averageSpeed;
+		diff /= averageSpeedCount;
+		averageSpeed += diff;
+
+		m365SetRegister(M365_REG_AVERAGE_SPEED, 1, averageSpeed);
+		m365SetRegister(M365_REG_AVERAGE_SPEED2, 1, averageSpeed);
+	}
+
+	if(tripTime != m365LastTripTime)
+	{
+		m365SetRegister(M365_REG_TRIP_TIME, 1, tripTime);
+		m365SetRegister(M365_REG_TRIP_TIME2, 1, tripTime);
+		m365LastTripTime = tripTime;
+	}
+}
\ No newline at end of file
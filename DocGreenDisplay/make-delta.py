@@ -0,0 +1,79 @@
+import sys, os, struct, hashlib
+
+# Generates a delta from the firmware currently running on a dashboard (base)
+# to a new firmware (target), see delta.hpp for the format:
+#   python3 make-delta.py old.bin new.bin
+# The delta is written next to the target as <target>.<md5 of base>.delta,
+# the name the dashboard looks for next to the configured update URL.
+
+BLOCK_SIZE = 32 # minimum length of a copy
+INDEX_STEP = 4 # base offsets indexed, copies have to contain an aligned block
+
+OP_END = 0x00
+OP_COPY = 0x01
+OP_INSERT = 0x02
+
+if len(sys.argv) not in (3, 4):
+    print("usage: {} <base.bin> <target.bin> [out.delta]".format(sys.argv[0]))
+    sys.exit(1)
+
+with open(sys.argv[1], "rb") as fd:
+    base = fd.read()
+with open(sys.argv[2], "rb") as fd:
+    target = fd.read()
+
+if len(sys.argv) == 4:
+    outPath = sys.argv[3]
+else:
+    name = os.path.splitext(sys.argv[2])[0]
+    outPath = "{}.{}.delta".format(name, hashlib.md5(base).hexdigest())
+
+index = {}
+for offset in range(0, len(base) - BLOCK_SIZE + 1, INDEX_STEP):
+    index.setdefault(base[offset:offset + BLOCK_SIZE], offset)
+
+ops = []
+pending = bytearray()
+
+def flushInsert():
+    global pending
+    if len(pending) > 0:
+        ops.append(struct.pack("<BI", OP_INSERT, len(pending)) + pending)
+    pending = bytearray()
+
+pos = 0
+while pos < len(target):
+    offset = index.get(target[pos:pos + BLOCK_SIZE])
+    if offset is None:
+        pending.append(target[pos])
+        pos += 1
+        continue
+
+    # grow the match backwards into the pending insert and forwards
+    start = offset
+    while start > 0 and len(pending) > 0 and base[start - 1] == pending[-1]:
+        start -= 1
+        pending.pop()
+
+    end = offset + BLOCK_SIZE
+    pos += BLOCK_SIZE
+    while end < len(base) and pos < len(target) and base[end] == target[pos]:
+        end += 1
+        pos += 1
+
+    flushInsert()
+    ops.append(struct.pack("<BII", OP_COPY, start, end - start))
+
+flushInsert()
+ops.append(struct.pack("<B", OP_END))
+
+header = b"DGD1" + struct.pack("<I", len(base)) + hashlib.sha256(base).digest() \
+    + struct.pack("<I", len(target)) + hashlib.sha256(target).digest()
+
+with open(outPath, "wb") as fd:
+    fd.write(header)
+    for op in ops:
+        fd.write(op)
+
+size = os.path.getsize(outPath)
+print("{}: {} bytes, {:.1f}% of the full image".format(outPath, size, size * 100 / len(target)))
\ No newline at end of file
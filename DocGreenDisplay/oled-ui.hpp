@@ -10,10 +10,9 @@
 
 uint8_t pressedButtons = 0;
 
-uint32_t configuredSpeed = 20;
-
 bool isLocked = false;
-String scooterPin;
+// set once initializeOledUi is done, it may run in the boot task
+volatile bool oledUiReady = false;
 
 #ifdef ARDUINO_ARCH_ESP32
 TwoWire I2CInstance = TwoWire(0);
@@ -192,12 +191,7 @@ void showLockMenu(docgreen_status_t& status)
 	static uint32_t lastMove = 0;
 	if(lastToggle == 0)
 	{
-		setLock(true);
-		delay(50);
-		setLock(true);
-		delay(50);
-		setLock(true);
-
+		queueBusCommand(BUS_COMMAND_LOCK, true);
 		lastToggle = 1;
 	}
 
@@ -228,12 +222,12 @@ void showLockMenu(docgreen_status_t& status)
 	if(buttons == 0)
 		return;
 
-	uint8_t wantedButton = 1 << (scooterPin[index] - '0');
+	uint8_t wantedButton = 1 << (settings.lockPin[index] - '0');
 	if((buttons & ~wantedButton) != 0)
 		failed = true;
 
 	index++;
-	if(index >= scooterPin.length())
+	if(index >= (int)strlen(settings.lockPin))
 	{
 		if(!failed)
 			isLocked = false;
@@ -248,11 +242,7 @@ void showLockMenu(docgreen_status_t& status)
 		display.println("HELLO");
 
 		lastToggle = 0;
-		setLock(false);
-		delay(50);
-		setLock(false);
-		delay(50);
-		setLock(false);
+		queueBusCommand(BUS_COMMAND_LOCK, false);
 	}
 	else
 	{
@@ -367,7 +357,7 @@ void showTuningMenu(uint8_t button)
 {
 	static uint32_t speed = 0;
 	if(speed == 0)
-		speed = configuredSpeed;
+		speed = settings.maxSpeed;
 
 	display.setTextSize(1);
 	display.println("max");
@@ -379,7 +369,7 @@ void showTuningMenu(uint8_t button)
 	display.println((speed * 2518) / 100);
 
 	display.println();
-	if(configuredSpeed == speed)
+	if(settings.maxSpeed == speed)
 		display.println("set");
 
 	if(button & BUTTON_DOWN)
@@ -395,8 +385,7 @@ void showTuningMenu(uint8_t button)
 	if(button & BUTTON_RIGHT)
 	{
 		setMaxSpeed(speed);
-		configuredSpeed = speed;
-		preferences.putUChar(PREFERENCE_MAX_SPEED, speed);
+		settingsSetUInt(SETTING_MAX_SPEED, speed);
 	}
 }
 
@@ -416,7 +405,7 @@ void showWifiMenu(uint8_t button)
 	if(wifiApEnabled)
 	{
 		display.println("pass:");
-		display.println(wifiApPassword);
+		display.println(settings.apPassword);
 	}
 	else if(onAfterReboot)
 	{
@@ -431,7 +420,7 @@ void showWifiMenu(uint8_t button)
 		display.println("on?");
 		if(button & BUTTON_RIGHT)
 		{
-			preferences.putUChar(PREFERENCE_AP_ENABLE, 1);
+			settingsSetUInt(SETTING_AP_ENABLE, 1);
 			onAfterReboot = true;
 		}
 	}
@@ -549,18 +538,16 @@ void initializeOledUi()
 	display.ssd1306_command(SSD1306_SETCONTRAST);
 	display.ssd1306_command(0xFF);
 
-	if(preferences.getUChar(PREFERENCE_SHOW_INTRO, 1))
+	if(settings.showIntro)
 		showIntro();
-	if(preferences.getUChar(PREFERENCE_LOCK_ON_BOOT, 0))
-		isLocked = true;
-
-	scooterPin = preferences.getString(PREFERENCE_LOCK_PIN, "012345");
 
 	display.clearDisplay();
 	display.setCursor(0, 0);
 	display.setTextSize(1);
 	display.println("wait\nfor\ndata\n...");
 	display.display();
+
+	oledUiReady = true;
 }
 
 void updateOledUi(docgreen_status_t &status)
@@ -580,6 +567,9 @@ void updateOledUi(docgreen_status_t &status)
 		getAndResetButtons();
 	}
 
+	if(!oledUiReady)
+		return;
+
 	display.clearDisplay();
 	display.setCursor(0, 0);
 
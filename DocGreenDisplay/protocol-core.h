@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdint.h>
+
+// Receiving side of the bus protocol shared by all targets (the ATtiny builds
+// use it through symlinks). A target selects the fields it needs with a mask,
+// the parser is a template on that mask and the target's status struct, so
+// code for unselected fields is never instantiated and the status struct only
+// needs members for the selected ones. Frames are consumed byte by byte and
+// values are only applied once the checksum matched.
+
+// report every frame with a valid checksum, not only the decoded ones
+#define DOCGREEN_ALL_FRAMES (1UL << 31)
+
+uint16_t calculateChecksum(uint8_t *data)
+{
+	uint8_t len = data[0] + 2;
+	uint16_t sum = 0;
+	for(int i = 0; i < len; i++)
+		sum += data[i];
+
+	sum ^= 0xFFFF;
+	return sum;
+}
+
+// sets byte k (0 is the least significant) of an integer, first is true for
+// the first byte of the field on the bus
+template<typename T>
+inline void docgreenSetByte(T& dst, uint8_t k, uint8_t val, bool first)
+{
+	if(first)
+		dst = 0;
+	dst |= (T)((uint32_t)val << (8 * k));
+}
+
+// every field is a template on whether it is selected, the unselected
+// variant never touches the status struct
+#define DOCGREEN_FIELD(name, setExpr) \
+	template<bool Selected> struct docgreen_field_##name \
+	{ \
+		template<typename S> static void set(S&, uint8_t, uint8_t, bool) {} \
+		template<typename S> static void copy(S&, const S&) {} \
+	}; \
+	template<> struct docgreen_field_##name<true> \
+	{ \
+		template<typename S> static void set(S& status, uint8_t k, uint8_t val, bool first) { setExpr; } \
+		template<typename S> static void copy(S& dst, const S& src) { dst.name = src.name; } \
+	};
+#define DOCGREEN_INT_FIELD(name) DOCGREEN_FIELD(name, docgreenSetByte(status.name, k, val, first))
+#define DOCGREEN_FLAG_FIELD(name, onValue) DOCGREEN_FIELD(name, (void)k; (void)first; status.name = val == onValue)
+
+#define DOCGREEN_FIELD_OF(name, bit) docgreen_field_##name<(Fields & (bit)) != 0>
+
+// field masks, packets and their decoder, generated from docgreen-protocol.json
+#include "./protocol-fields.h"
+
+// the position in a frame of up to 251 bytes payload goes up to 256
+template<bool Wide> struct docgreen_position_t { typedef uint8_t type; };
+template<> struct docgreen_position_t<true> { typedef uint16_t type; };
+
+template<uint32_t Fields, typename Status>
+struct docgreen_parser_t
+{
+	static const bool allFrames = (Fields & DOCGREEN_ALL_FRAMES) != 0;
+	// longer frames are garbage for us, parsers not taking all frames keep
+	// their positions within uint8_t
+	static const uint8_t maxLength = allFrames ? 251 : docgreenMaxLength(Fields);
+
+	typename docgreen_position_t<(maxLength > 250)>::type pos; // position in the frame, 0 while waiting for 0x55
+	uint8_t len;
+	docgreen_packet_t packet;
+	uint8_t checksumLow;
+	uint16_t sum;
+	Status staged; // values of the current frame, applied once the checksum matched
+
+	// consumes one received byte, returns true when it completed a valid
+	// frame and its values were applied to status
+	bool feed(Status& status, uint8_t val)
+	{
+		if(pos == 0)
+		{
+			if(val == 0x55)
+				pos = 1;
+			return false;
+		}
+		else if(pos == 1)
+		{
+			pos = val == 0xAA ? 2 : (val == 0x55 ? 1 : 0);
+			return false;
+		}
+
+		uint8_t i = pos - 2;
+		pos++;
+
+		if(i == 0)
+		{
+			len = val;
+			sum = val;
+			if(len == 0 || len > maxLength)
+				pos = 0;
+		}
+		else if(i < len + 2)
+		{
+			sum += val;
+			// i is the index of the byte as in docgreen-protocol.md
+			if(i <= 3)
+				packet = docgreenSelectPacket<Fields>(packet, len, i, val);
+			else
+				docgreenDecode<Fields>(packet, staged, i, val);
+
+			if(!allFrames && packet == DOCGREEN_PACKET_NONE)
+				pos = 0;
+		}
+		else if(i == len + 2)
+		{
+			checksumLow = val;
+		}
+		else
+		{
+			pos = 0;
+
+			uint16_t actualChecksum = checksumLow | ((uint16_t)val << 8);
+			if(actualChecksum != (sum ^ 0xFFFF))
+				return false;
+
+			docgreenApply<Fields>(packet, status, staged);
+			return true;
+		}
+
+		return false;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,212 @@
+#pragma once
+
+// autogenerated by generate-protocol.py from docgreen-protocol.json, do not edit
+// included by protocol-core.h, which defines the macros used below
+
+// motor controller information, address 28
+#define DOCGREEN_ECO_MODE (1UL << 0)
+#define DOCGREEN_SHUTTING_DOWN (1UL << 1)
+#define DOCGREEN_LIGHTS (1UL << 2)
+#define DOCGREEN_SPEED (1UL << 3)
+#define DOCGREEN_BUTTON_PRESS (1UL << 4)
+#define DOCGREEN_ERROR_CODE (1UL << 5)
+#define DOCGREEN_SOC (1UL << 6)
+// detailed information 1, address 11 arg 00
+#define DOCGREEN_TOTAL_OPERATION_TIME (1UL << 7)
+#define DOCGREEN_TIME_SINCE_BOOT (1UL << 8)
+#define DOCGREEN_VOLTAGE (1UL << 9)
+#define DOCGREEN_CURRENT (1UL << 10)
+// detailed information 2, address 11 arg 28
+#define DOCGREEN_MAINBOARD_VERSION (1UL << 11)
+#define DOCGREEN_ODOMETER (1UL << 12)
+// input information, address 25 command 60
+#define DOCGREEN_THROTTLE (1UL << 13)
+#define DOCGREEN_BRAKE (1UL << 14)
+
+#define DOCGREEN_MOTOR_INFO_FIELDS (DOCGREEN_ECO_MODE | DOCGREEN_SHUTTING_DOWN | DOCGREEN_LIGHTS | DOCGREEN_SPEED | DOCGREEN_BUTTON_PRESS | DOCGREEN_ERROR_CODE | DOCGREEN_SOC)
+#define DOCGREEN_DETAILED_INFO_1_FIELDS (DOCGREEN_TOTAL_OPERATION_TIME | DOCGREEN_TIME_SINCE_BOOT | DOCGREEN_VOLTAGE | DOCGREEN_CURRENT)
+#define DOCGREEN_DETAILED_INFO_2_FIELDS (DOCGREEN_MAINBOARD_VERSION | DOCGREEN_ODOMETER)
+#define DOCGREEN_INPUT_FIELDS (DOCGREEN_THROTTLE | DOCGREEN_BRAKE)
+
+typedef enum : uint8_t
+{
+	DOCGREEN_PACKET_NONE,
+	DOCGREEN_PACKET_MOTOR_INFO,
+	DOCGREEN_PACKET_DETAILED_INFO_1,
+	DOCGREEN_PACKET_DETAILED_INFO_2,
+	DOCGREEN_PACKET_INPUT,
+} docgreen_packet_t;
+
+DOCGREEN_FLAG_FIELD(ecoMode, 0x02)
+DOCGREEN_FLAG_FIELD(shuttingDown, 0x08)
+DOCGREEN_FLAG_FIELD(lights, 0x01)
+DOCGREEN_INT_FIELD(speed)
+DOCGREEN_FLAG_FIELD(buttonPress, 0x01)
+DOCGREEN_INT_FIELD(errorCode)
+DOCGREEN_INT_FIELD(soc)
+DOCGREEN_INT_FIELD(totalOperationTime)
+DOCGREEN_INT_FIELD(timeSinceBoot)
+DOCGREEN_INT_FIELD(voltage)
+DOCGREEN_INT_FIELD(current)
+DOCGREEN_INT_FIELD(mainboardVersion)
+DOCGREEN_INT_FIELD(odometer)
+DOCGREEN_INT_FIELD(throttle)
+DOCGREEN_INT_FIELD(brake)
+
+constexpr uint8_t docgreenMaxLength(uint32_t fields)
+{
+	return (fields & DOCGREEN_DETAILED_INFO_1_FIELDS) ? 0x34
+		: (fields & DOCGREEN_DETAILED_INFO_2_FIELDS) ? 0x34
+		: (fields & DOCGREEN_MOTOR_INFO_FIELDS) ? 0x0b
+		: (fields & DOCGREEN_INPUT_FIELDS) ? 0x07
+		: 0;
+}
+
+template<uint32_t Fields>
+docgreen_packet_t docgreenSelectPacket(docgreen_packet_t packet, uint8_t len, uint8_t i, uint8_t val)
+{
+	if(i == 1)
+	{
+		if((Fields & DOCGREEN_MOTOR_INFO_FIELDS) && val == 0x28 && len == 0x0b)
+			return DOCGREEN_PACKET_MOTOR_INFO;
+		if((Fields & (DOCGREEN_DETAILED_INFO_1_FIELDS | DOCGREEN_DETAILED_INFO_2_FIELDS)) && val == 0x11 && len == 0x34)
+			return DOCGREEN_PACKET_DETAILED_INFO_1;
+		if((Fields & DOCGREEN_INPUT_FIELDS) && val == 0x25 && len == 0x07)
+			return DOCGREEN_PACKET_INPUT;
+		return DOCGREEN_PACKET_NONE;
+	}
+	else if(i == 2)
+	{
+		if(packet == DOCGREEN_PACKET_INPUT && val != 0x60)
+			return DOCGREEN_PACKET_NONE;
+	}
+	else if(i == 3)
+	{
+		if(packet == DOCGREEN_PACKET_DETAILED_INFO_1)
+		{
+			if((Fields & DOCGREEN_DETAILED_INFO_1_FIELDS) && val == 0x00)
+				return DOCGREEN_PACKET_DETAILED_INFO_1;
+			if((Fields & DOCGREEN_DETAILED_INFO_2_FIELDS) && val == 0x28)
+				return DOCGREEN_PACKET_DETAILED_INFO_2;
+			return DOCGREEN_PACKET_NONE;
+		}
+	}
+
+	return packet;
+}
+
+template<uint32_t Fields, typename Status>
+void docgreenDecode(docgreen_packet_t packet, Status& staged, uint8_t i, uint8_t val)
+{
+	switch(packet)
+	{
+		case DOCGREEN_PACKET_MOTOR_INFO:
+			switch(i)
+			{
+				case 4:
+					DOCGREEN_FIELD_OF(ecoMode, DOCGREEN_ECO_MODE)::set(staged, 0, val, true);
+					break;
+				case 5:
+					DOCGREEN_FIELD_OF(shuttingDown, DOCGREEN_SHUTTING_DOWN)::set(staged, 0, val, true);
+					break;
+				case 6:
+					DOCGREEN_FIELD_OF(lights, DOCGREEN_LIGHTS)::set(staged, 0, val, true);
+					break;
+				case 8: case 9:
+					DOCGREEN_FIELD_OF(speed, DOCGREEN_SPEED)::set(staged, i - 8, val, i == 8);
+					break;
+				case 10:
+					DOCGREEN_FIELD_OF(buttonPress, DOCGREEN_BUTTON_PRESS)::set(staged, 0, val, true);
+					break;
+				case 11:
+					DOCGREEN_FIELD_OF(errorCode, DOCGREEN_ERROR_CODE)::set(staged, 0, val, true);
+					break;
+				case 12:
+					DOCGREEN_FIELD_OF(soc, DOCGREEN_SOC)::set(staged, 0, val, true);
+					break;
+			}
+			break;
+
+		case DOCGREEN_PACKET_DETAILED_INFO_1:
+			switch(i)
+			{
+				case 4: case 5: case 6: case 7:
+					DOCGREEN_FIELD_OF(totalOperationTime, DOCGREEN_TOTAL_OPERATION_TIME)::set(staged, i - 4, val, i == 4);
+					break;
+				case 20: case 21: case 22: case 23:
+					DOCGREEN_FIELD_OF(timeSinceBoot, DOCGREEN_TIME_SINCE_BOOT)::set(staged, i - 20, val, i == 20);
+					break;
+				case 46: case 47:
+					DOCGREEN_FIELD_OF(voltage, DOCGREEN_VOLTAGE)::set(staged, i - 46, val, i == 46);
+					break;
+				case 48: case 49:
+					DOCGREEN_FIELD_OF(current, DOCGREEN_CURRENT)::set(staged, i - 48, val, i == 48);
+					break;
+			}
+			break;
+
+		case DOCGREEN_PACKET_DETAILED_INFO_2:
+			switch(i)
+			{
+				case 10: case 11: case 12: case 13:
+					DOCGREEN_FIELD_OF(mainboardVersion, DOCGREEN_MAINBOARD_VERSION)::set(staged, i - 10, val, i == 10);
+					break;
+				case 34: case 35: case 36: case 37:
+					DOCGREEN_FIELD_OF(odometer, DOCGREEN_ODOMETER)::set(staged, i - 34, val, i == 34);
+					break;
+			}
+			break;
+
+		case DOCGREEN_PACKET_INPUT:
+			switch(i)
+			{
+				case 5:
+					DOCGREEN_FIELD_OF(throttle, DOCGREEN_THROTTLE)::set(staged, 0, val, true);
+					break;
+				case 6:
+					DOCGREEN_FIELD_OF(brake, DOCGREEN_BRAKE)::set(staged, 0, val, true);
+					break;
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+template<uint32_t Fields, typename Status>
+void docgreenApply(docgreen_packet_t packet, Status& status, const Status& staged)
+{
+	switch(packet)
+	{
+		case DOCGREEN_PACKET_MOTOR_INFO:
+			DOCGREEN_FIELD_OF(ecoMode, DOCGREEN_ECO_MODE)::copy(status, staged);
+			DOCGREEN_FIELD_OF(shuttingDown, DOCGREEN_SHUTTING_DOWN)::copy(status, staged);
+			DOCGREEN_FIELD_OF(lights, DOCGREEN_LIGHTS)::copy(status, staged);
+			DOCGREEN_FIELD_OF(speed, DOCGREEN_SPEED)::copy(status, staged);
+			DOCGREEN_FIELD_OF(buttonPress, DOCGREEN_BUTTON_PRESS)::copy(status, staged);
+			DOCGREEN_FIELD_OF(errorCode, DOCGREEN_ERROR_CODE)::copy(status, staged);
+			DOCGREEN_FIELD_OF(soc, DOCGREEN_SOC)::copy(status, staged);
+			break;
+
+		case DOCGREEN_PACKET_DETAILED_INFO_1:
+			DOCGREEN_FIELD_OF(totalOperationTime, DOCGREEN_TOTAL_OPERATION_TIME)::copy(status, staged);
+			DOCGREEN_FIELD_OF(timeSinceBoot, DOCGREEN_TIME_SINCE_BOOT)::copy(status, staged);
+			DOCGREEN_FIELD_OF(voltage, DOCGREEN_VOLTAGE)::copy(status, staged);
+			DOCGREEN_FIELD_OF(current, DOCGREEN_CURRENT)::copy(status, staged);
+			break;
+
+		case DOCGREEN_PACKET_DETAILED_INFO_2:
+			DOCGREEN_FIELD_OF(mainboardVersion, DOCGREEN_MAINBOARD_VERSION)::copy(status, staged);
+			DOCGREEN_FIELD_OF(odometer, DOCGREEN_ODOMETER)::copy(status, staged);
+			break;
+
+		case DOCGREEN_PACKET_INPUT:
+			DOCGREEN_FIELD_OF(throttle, DOCGREEN_THROTTLE)::copy(status, staged);
+			DOCGREEN_FIELD_OF(brake, DOCGREEN_BRAKE)::copy(status, staged);
+			break;
+
+		default:
+			break;
+	}
+}
@@ -3,6 +3,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "protocol-core.h"
+
 #if defined(__AVR__)
 #ifndef ScooterSerial
 #define ScooterSerial Serial
@@ -46,17 +48,6 @@ typedef struct
 	uint32_t odometer; // in meter
 } docgreen_status_t;
 
-uint16_t calculateChecksum(uint8_t *data)
-{
-	uint8_t len = data[0] + 2;
-	uint16_t sum = 0;
-	for(int i = 0; i < len; i++)
-		sum += data[i];
-
-	sum ^= 0xFFFF;
-	return sum;
-}
-
 void setMaxSpeed(uint8_t speed)
 {
 	uint8_t data[] = {
@@ -192,86 +183,25 @@ void sendBleConnected()
 	RX_ENABLE;
 }
 
-void parseDetailedInfo(docgreen_status_t *status, uint8_t *buff)
-{
-	if(buff[0] != 0x34) // expect length 52
-		return;
-
-	// XXX we assume our architecture uses LE order here
-	if(buff[3] == 0x00)
-	{
-		status->totalOperationTime = *(uint32_t *)&buff[4];
-		status->timeSinceBoot = *(uint32_t *)&buff[20];
-		status->voltage = *(uint16_t *)&buff[46];
-		status->current = *(int16_t *)&buff[48];
-	}
-	else if(buff[3] == 0x28)
-	{
-		status->mainboardVersion = *(uint32_t *)&buff[10];
-		status->odometer = *(uint32_t *)&buff[34];
-	}
-}
-
-void parseMotorInfoPacket(docgreen_status_t *status, uint8_t *buff)
-{
-	if(buff[0] != 0x0b) // expect length 11
-		return;
+#define DISPLAY_STATUS_FIELDS (DOCGREEN_MOTOR_INFO_FIELDS | DOCGREEN_DETAILED_INFO_1_FIELDS \
+	| DOCGREEN_DETAILED_INFO_2_FIELDS | DOCGREEN_ALL_FRAMES)
 
-	status->ecoMode = buff[4] == 0x02;
-	status->shuttingDown = buff[5] == 0x08;
-	status->lights = buff[6] == 0x01;
-	status->buttonPress = buff[10] == 0x01;
-	status->errorCode = buff[11];
-	status->soc = buff[12];
-	status->speed = *(uint16_t *)&buff[8]; // XXX we assume our architecture uses LE order here
-}
+static docgreen_parser_t<DISPLAY_STATUS_FIELDS, docgreen_status_t> statusParser;
 
-uint8_t readWithDefault(uint8_t defaultVal = 0x00)
-{
-	// give the scooter some time
-	if(!ScooterSerial.available())
-		delay(1);
+// sniffer.hpp
+void snifferByte(uint8_t val);
 
-	if(ScooterSerial.available())
-		return ScooterSerial.read();
-	else
-		return defaultVal;
-}
+// consumes the received bytes without waiting for the rest of a frame,
+// returns true when a frame with a valid checksum was completed
 bool receivePacket(docgreen_status_t *status)
 {
-	if(readWithDefault() != 0x55)
-		return false;
-	if(readWithDefault() != 0xAA)
-		return false;
-
-	uint8_t buff[256];
-
-	uint8_t len = readWithDefault();
-	buff[0] = len;
-	if(len == 0 || len >= sizeof(buff) - 4)
-		return false;
-
-	uint8_t addr = readWithDefault();
-	buff[1] = addr;
-
-	for(int i = 0; i < len; i++)
+	while(ScooterSerial.available())
 	{
-		buff[i + 2] = readWithDefault(0xFF);
+		uint8_t val = ScooterSerial.read();
+		snifferByte(val);
+		if(statusParser.feed(*status, val))
+			return true;
 	}
 
-	uint16_t actualChecksum = (uint16_t)readWithDefault() | ((uint16_t)readWithDefault() << 8);
-	uint16_t expectedChecksum = calculateChecksum(buff);
-	if(actualChecksum != expectedChecksum)
-		return false;
-
-	switch(addr)
-	{
-		case 0x11:
-			parseDetailedInfo(status, buff);
-			break;
-		case 0x28:
-			parseMotorInfoPacket(status, buff);
-			break;
-	}
-	return true;
+	return false;
 }
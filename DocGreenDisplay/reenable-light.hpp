@@ -3,14 +3,18 @@
 #include "state.hpp"
 #include "protocol.h"
 
-bool reenableLightsAfterError = false;
 static uint8_t reenableLightTimeout = 0;
 static bool lightShouldBeOn = false;
 
-void internalSetLight(bool shouldBeOn)
+void rememberLightState(bool shouldBeOn)
 {
     reenableLightTimeout = 20;
     lightShouldBeOn = shouldBeOn;
+}
+
+void internalSetLight(bool shouldBeOn)
+{
+    rememberLightState(shouldBeOn);
 
     setLight(shouldBeOn);
     setLight(shouldBeOn);
@@ -19,7 +23,7 @@ void internalSetLight(bool shouldBeOn)
 
 void reenableLightLoop(docgreen_status_t& scooterStatus)
 {
-    if(!reenableLightsAfterError)
+    if(!settings.reenableLight)
         return;	
 
     if(reenableLightTimeout > 0)
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free ring buffer for exactly one producer and one consumer, which may
+// run in different tasks or on different cores. N has to be a power of two,
+// one slot stays empty to tell a full from an empty ring.
+template<typename T, uint16_t N>
+struct spsc_ring_t
+{
+	static_assert((N & (N - 1)) == 0, "N has to be a power of two.");
+
+	T entries[N];
+	std::atomic<uint16_t> head; // next slot written by the producer
+	std::atomic<uint16_t> tail; // next slot read by the consumer
+
+	// producer only, returns false if the ring is full
+	bool push(const T& entry)
+	{
+		uint16_t curr = head.load(std::memory_order_relaxed);
+		uint16_t next = (curr + 1) & (N - 1);
+		if(next == tail.load(std::memory_order_acquire))
+			return false;
+
+		entries[curr] = entry;
+		head.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// consumer only, returns false if the ring is empty
+	bool pop(T& entry)
+	{
+		uint16_t curr = tail.load(std::memory_order_relaxed);
+		if(curr == head.load(std::memory_order_acquire))
+			return false;
+
+		entry = entries[curr];
+		tail.store((curr + 1) & (N - 1), std::memory_order_release);
+		return true;
+	}
+
+	uint16_t size() const
+	{
+		return (head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire)) & (N - 1);
+	}
+};
\ No newline at end of file
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "protocol.h"
+
+// Allocation free serialization of docgreen_status_t for the webinterface.
+// Everything is written into a buffer provided by the caller, the field table
+// is derived from the struct definition at compile time.
+
+typedef enum : uint8_t
+{
+	STATUS_FIELD_BOOL,
+	STATUS_FIELD_UINT8,
+	STATUS_FIELD_UINT16,
+	STATUS_FIELD_INT16,
+	STATUS_FIELD_UINT32,
+} status_field_type_t;
+
+typedef struct
+{
+	const char *name;
+	uint8_t offset;
+	uint8_t size;
+	status_field_type_t type;
+} status_field_t;
+
+template<typename T> struct status_field_type_of;
+template<> struct status_field_type_of<bool> { static const status_field_type_t value = STATUS_FIELD_BOOL; };
+template<> struct status_field_type_of<uint8_t> { static const status_field_type_t value = STATUS_FIELD_UINT8; };
+template<> struct status_field_type_of<uint16_t> { static const status_field_type_t value = STATUS_FIELD_UINT16; };
+template<> struct status_field_type_of<int16_t> { static const status_field_type_t value = STATUS_FIELD_INT16; };
+template<> struct status_field_type_of<uint32_t> { static const status_field_type_t value = STATUS_FIELD_UINT32; };
+
+#define STATUS_FIELD(name) { \
+		#name, \
+		offsetof(docgreen_status_t, name), \
+		sizeof(docgreen_status_t::name), \
+		status_field_type_of<decltype(docgreen_status_t::name)>::value, \
+	}
+
+// the order of this table defines the order of the JSON keys and binary fields
+static constexpr status_field_t statusFields[] = {
+	STATUS_FIELD(throttle),
+	STATUS_FIELD(brake),
+	STATUS_FIELD(ecoMode),
+	STATUS_FIELD(shuttingDown),
+	STATUS_FIELD(lights),
+	STATUS_FIELD(buttonPress),
+	STATUS_FIELD(errorCode),
+	STATUS_FIELD(soc),
+	STATUS_FIELD(speed),
+	STATUS_FIELD(totalOperationTime),
+	STATUS_FIELD(timeSinceBoot),
+	STATUS_FIELD(voltage),
+	STATUS_FIELD(current),
+	STATUS_FIELD(mainboardVersion),
+	STATUS_FIELD(odometer),
+};
+
+#define STATUS_FIELD_COUNT (sizeof(statusFields) / sizeof(*statusFields))
+#define STATUS_FIELDS_ALL ((uint32_t)((1ULL << STATUS_FIELD_COUNT) - 1))
+
+static_assert(STATUS_FIELD_COUNT <= 32, "Status field mask does not fit.");
+
+constexpr uint32_t statusFieldBit(size_t offset, uint8_t i = 0)
+{
+	return i >= STATUS_FIELD_COUNT ? 0
+		: statusFields[i].offset == offset ? 1UL << i
+		: statusFieldBit(offset, i + 1);
+}
+
+// the bit of a field in the masks used below, e.g. STATUS_FIELD_BIT(speed)
+#define STATUS_FIELD_BIT(name) statusFieldBit(offsetof(docgreen_status_t, name))
+
+// largest JSON object serializeStatusJson can produce, including the braces
+#define STATUS_JSON_MAX_LENGTH (STATUS_FIELD_COUNT * 32 + 2)
+
+// a bit for each field in statusFields which differs between a and b
+uint32_t statusFieldsChanged(const docgreen_status_t& a, const docgreen_status_t& b)
+{
+	uint32_t mask = 0;
+	for(uint8_t i = 0; i < STATUS_FIELD_COUNT; i++)
+	{
+		const status_field_t& field = statusFields[i];
+		if(memcmp((const uint8_t *)&a + field.offset, (const uint8_t *)&b + field.offset, field.size) != 0)
+			mask |= 1UL << i;
+	}
+	return mask;
+}
+
+//
+// JSON
+//
+
+typedef struct
+{
+	char *buff;
+	size_t size;
+	size_t len; // might exceed size, in which case the output was truncated
+	bool first;
+} json_writer_t;
+
+static void jsonRaw(json_writer_t& writer, const char *str, size_t len)
+{
+	if(writer.len + len < writer.size)
+		memcpy(writer.buff + writer.len, str, len);
+	writer.len += len;
+}
+static void jsonChar(json_writer_t& writer, char c)
+{
+	if(writer.len + 1 < writer.size)
+		writer.buff[writer.len] = c;
+	writer.len++;
+}
+
+void jsonBegin(json_writer_t& writer, char *buff, size_t size)
+{
+	writer.buff = buff;
+	writer.size = size;
+	writer.len = 0;
+	writer.first = true;
+	jsonChar(writer, '{');
+}
+
+// closes the object and returns its length, or 0 when buff was too small
+size_t jsonEnd(json_writer_t& writer)
+{
+	jsonChar(writer, '}');
+	if(writer.len >= writer.size)
+		return 0;
+
+	writer.buff[writer.len] = 0;
+	return writer.len;
+}
+
+void jsonKey(json_writer_t& writer, const char *name)
+{
+	if(!writer.first)
+		jsonRaw(writer, ", ", 2);
+	writer.first = false;
+
+	jsonChar(writer, '"');
+	jsonRaw(writer, name, strlen(name));
+	jsonRaw(writer, "\": ", 3);
+}
+
+void jsonUInt(json_writer_t& writer, uint32_t val)
+{
+	char digits[10];
+	uint8_t count = 0;
+	do
+	{
+		digits[count++] = '0' + val % 10;
+		val /= 10;
+	} while(val != 0);
+
+	while(count > 0)
+		jsonChar(writer, digits[--count]);
+}
+
+void jsonInt(json_writer_t& writer, int32_t val)
+{
+	if(val < 0)
+	{
+		jsonChar(writer, '-');
+		jsonUInt(writer, -(uint32_t)val);
+	}
+	else
+	{
+		jsonUInt(writer, val);
+	}
+}
+
+void jsonString(json_writer_t& writer, const char *str)
+{
+	jsonChar(writer, '"');
+	for(; *str != 0; str++)
+	{
+		if(*str == '"' || *str == '\\')
+		{
+			jsonChar(writer, '\\');
+			jsonChar(writer, *str);
+		}
+		else if((uint8_t)*str >= 0x20)
+		{
+			jsonChar(writer, *str);
+		}
+	}
+	jsonChar(writer, '"');
+}
+
+// writes the fields selected by mask as key value pairs into an open object
+void serializeStatusJson(json_writer_t& writer, const docgreen_status_t& status, uint32_t mask = STATUS_FIELDS_ALL)
+{
+	for(uint8_t i = 0; i < STATUS_FIELD_COUNT; i++)
+	{
+		if((mask & (1UL << i)) == 0)
+			continue;
+
+		const status_field_t& field = statusFields[i];
+		const uint8_t *ptr = (const uint8_t *)&status + field.offset;
+
+		jsonKey(writer, field.name);
+		switch(field.type)
+		{
+			case STATUS_FIELD_BOOL:
+				jsonUInt(writer, *(const bool *)ptr);
+				break;
+			case STATUS_FIELD_UINT8:
+				jsonUInt(writer, *ptr);
+				break;
+			case STATUS_FIELD_UINT16:
+				jsonUInt(writer, *(const uint16_t *)ptr);
+				break;
+			case STATUS_FIELD_INT16:
+				jsonInt(writer, *(const int16_t *)ptr);
+				break;
+			case STATUS_FIELD_UINT32:
+				jsonUInt(writer, *(const uint32_t *)ptr);
+				break;
+		}
+	}
+}
+
+//
+// binary
+//
+// The binary encoding starts with the field mask as little endian uint32_t,
+// followed by every field selected by the mask in the order of statusFields,
+// each little endian with the width of its struct member.
+//
+
+#define STATUS_BINARY_MAX_LENGTH (4 + sizeof(docgreen_status_t))
+
+// returns the number of bytes written, or 0 when buff was too small
+size_t serializeStatusBinary(uint8_t *buff, size_t size, const docgreen_status_t& status, uint32_t mask = STATUS_FIELDS_ALL)
+{
+	if(size < 4)
+		return 0;
+
+	// XXX we assume our architecture uses LE order here
+	memcpy(buff, &mask, 4);
+	size_t len = 4;
+
+	for(uint8_t i = 0; i < STATUS_FIELD_COUNT; i++)
+	{
+		if((mask & (1UL << i)) == 0)
+			continue;
+
+		const status_field_t& field = statusFields[i];
+		if(len + field.size > size)
+			return 0;
+
+		memcpy(buff + len, (const uint8_t *)&status + field.offset, field.size);
+		len += field.size;
+	}
+
+	return len;
+}
\ No newline at end of file
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "config.h"
+#include "state.hpp"
+
+// All user settings live in RAM in the settings struct, which is loaded once
+// at boot and read with plain member access. Changes are collected in a dirty
+// mask and persisted as one versioned blob by settingsCommit().
+
+// bump when scooter_settings_t changes, older blobs are then discarded
+#define SETTINGS_VERSION 1
+#define SETTINGS_BLOB_KEY "settings"
+
+typedef enum : uint8_t
+{
+	SETTING_BOOL,
+	SETTING_UINT8,
+	SETTING_STRING,
+} setting_type_t;
+
+typedef struct
+{
+	const char *key; // NVS key of older versions and name in the webinterface
+	setting_type_t type;
+	uint16_t offset;
+	uint8_t size;
+	uint8_t min; // minimum value, or minimum length for strings
+	uint8_t max; // maximum value, or maximum length for strings
+	uint8_t defaultValue;
+	const char *defaultString;
+} setting_t;
+
+#define SETTING_BOOL_ENTRY(field, key, def) \
+	{key, SETTING_BOOL, offsetof(scooter_settings_t, field), \
+		sizeof(scooter_settings_t::field), 0, 1, def, NULL}
+#define SETTING_UINT8_ENTRY(field, key, def, min, max) \
+	{key, SETTING_UINT8, offsetof(scooter_settings_t, field), \
+		sizeof(scooter_settings_t::field), min, max, def, NULL}
+#define SETTING_STRING_ENTRY(field, key, def, minLength) \
+	{key, SETTING_STRING, offsetof(scooter_settings_t, field), \
+		sizeof(scooter_settings_t::field), minLength, sizeof(scooter_settings_t::field) - 1, 0, def}
+
+// same order as setting_id_t
+static const setting_t settingsTable[] = {
+	SETTING_UINT8_ENTRY(maxSpeed, "max-speed", 20, 12, 40),
+	SETTING_BOOL_ENTRY(showIntro, "show-intro", 1),
+	SETTING_BOOL_ENTRY(reenableLight, "reenable-light", 0),
+	SETTING_BOOL_ENTRY(lockOnBoot, "lock-on-boot", 0),
+	SETTING_STRING_ENTRY(lockPin, "lock-pin", "012345", 1),
+	SETTING_BOOL_ENTRY(bleEnable, "ble-enable", 0),
+	SETTING_BOOL_ENTRY(bleControlEnable, "ble-ctrl-enable", 0),
+	SETTING_BOOL_ENTRY(apEnable, "ap-enable", 1),
+	SETTING_STRING_ENTRY(apSsid, "ap-ssid", "", 0),
+	SETTING_STRING_ENTRY(apPassword, "ap-pw", "", 0),
+	SETTING_BOOL_ENTRY(staEnable, "sta-enable", 0),
+	SETTING_STRING_ENTRY(staSsid, "sta-ssid", "", 0),
+	SETTING_STRING_ENTRY(staPassword, "sta-pw", "", 0),
+	SETTING_STRING_ENTRY(updateUrl, "update-url", DEFAULT_UPDATE_URL, 0),
+	SETTING_BOOL_ENTRY(fastBoot, "fast-boot", 0),
+	SETTING_BOOL_ENTRY(snifferEnable, "sniffer-enable", 0),
+};
+
+#define SETTINGS_COUNT (sizeof(settingsTable) / sizeof(*settingsTable))
+static_assert(SETTINGS_COUNT == SETTING_COUNT, "settingsTable does not match setting_id_t.");
+static_assert(SETTINGS_COUNT <= 32, "Settings dirty mask does not fit.");
+
+typedef struct
+{
+	uint8_t version;
+	scooter_settings_t settings;
+} settings_blob_t;
+
+scooter_settings_t settings;
+static uint32_t settingsDirty = 0;
+static SemaphoreHandle_t settingsCommitMutex;
+
+static void *settingPtr(scooter_settings_t& target, const setting_t& setting)
+{
+	return (uint8_t *)&target + setting.offset;
+}
+
+static void settingsLoadDefaults()
+{
+	for(uint8_t i = 0; i < SETTINGS_COUNT; i++)
+	{
+		const setting_t& setting = settingsTable[i];
+		void *ptr = settingPtr(settings, setting);
+
+		if(setting.type == SETTING_STRING)
+			strlcpy((char *)ptr, setting.defaultString, setting.size);
+		else if(setting.type == SETTING_BOOL)
+			*(bool *)ptr = setting.defaultValue;
+		else
+			*(uint8_t *)ptr = setting.defaultValue;
+	}
+}
+
+// reads the separate keys used before all settings were stored in one blob.
+// Older firmware didn't validate them, numbers are clamped and strings are
+// truncated to the current limits. Returns the mask of values which are still
+// invalid, e.g. a lock pin with digits above 5, they keep their default.
+static uint32_t settingsMigrate()
+{
+	uint32_t rejected = 0;
+	for(uint8_t i = 0; i < SETTINGS_COUNT; i++)
+	{
+		const setting_t& setting = settingsTable[i];
+		if(!preferences.isKey(setting.key))
+			continue;
+
+		bool valid;
+		if(setting.type == SETTING_STRING)
+		{
+			String val = preferences.getString(setting.key, setting.defaultString);
+			char buff[256];
+			strlcpy(buff, val.c_str(), setting.size);
+			valid = settingsSetString((setting_id_t)i, buff);
+		}
+		else
+		{
+			uint32_t val = preferences.getUChar(setting.key, setting.defaultValue);
+			if(setting.type == SETTING_BOOL)
+				val = val != 0;
+			else if(val < setting.min)
+				val = setting.min;
+			else if(val > setting.max)
+				val = setting.max;
+			valid = settingsSetUInt((setting_id_t)i, val);
+		}
+
+		if(!valid)
+			rejected |= 1UL << i;
+	}
+	return rejected;
+}
+// the keys of rejected values are kept, so they are not lost
+static void settingsRemoveOldKeys(uint32_t rejected)
+{
+	for(uint8_t i = 0; i < SETTINGS_COUNT; i++)
+	{
+		if((rejected & (1UL << i)) == 0 && preferences.isKey(settingsTable[i].key))
+			preferences.remove(settingsTable[i].key);
+	}
+}
+
+void settingsLoad()
+{
+	settingsCommitMutex = xSemaphoreCreateMutex();
+	settingsLoadDefaults();
+
+	// blobs of older firmware are shorter, settings are only appended to
+	// scooter_settings_t, so the missing ones keep their defaults
+	settings_blob_t blob;
+	blob.settings = settings;
+	size_t length = preferences.getBytesLength(SETTINGS_BLOB_KEY);
+	if(length > offsetof(settings_blob_t, settings) && length <= sizeof(blob)
+		&& preferences.getBytes(SETTINGS_BLOB_KEY, &blob, length) == length
+		&& blob.version == SETTINGS_VERSION)
+	{
+		settings = blob.settings;
+		if(length < sizeof(blob))
+			settingsDirty = 0xffffffff;
+
+		// never trust strings read from flash to be terminated
+		for(uint8_t i = 0; i < SETTINGS_COUNT; i++)
+		{
+			const setting_t& setting = settingsTable[i];
+			if(setting.type == SETTING_STRING)
+				((char *)settingPtr(settings, setting))[setting.size - 1] = 0;
+		}
+	}
+	else
+	{
+		uint32_t rejected = settingsMigrate();
+		settingsDirty = 0xffffffff;
+
+		// a failed write migrates the old keys again on the next boot
+		if(settingsCommit())
+			settingsRemoveOldKeys(rejected);
+	}
+}
+
+bool settingsValid(setting_id_t id, uint32_t val)
+{
+	const setting_t& setting = settingsTable[id];
+	return val >= setting.min && val <= setting.max;
+}
+bool settingsValid(setting_id_t id, const char *val)
+{
+	const setting_t& setting = settingsTable[id];
+	size_t len = strlen(val);
+	if(len < setting.min || len > setting.max)
+		return false;
+
+	// every digit of the pin is the bit of a button in pressedButtons
+	if(id == SETTING_LOCK_PIN)
+	{
+		for(size_t i = 0; i < len; i++)
+		{
+			if(val[i] < '0' || val[i] > '5')
+				return false;
+		}
+	}
+
+	return true;
+}
+
+// setters return false if the value is out of range, unchanged values
+// don't mark the setting as dirty
+bool settingsSetUInt(setting_id_t id, uint32_t val)
+{
+	const setting_t& setting = settingsTable[id];
+	if(setting.type == SETTING_STRING || !settingsValid(id, val))
+		return false;
+
+	void *ptr = settingPtr(settings, setting);
+	if(setting.type == SETTING_BOOL)
+	{
+		if(*(bool *)ptr == (bool)val)
+			return true;
+		*(bool *)ptr = val;
+	}
+	else
+	{
+		if(*(uint8_t *)ptr == val)
+			return true;
+		*(uint8_t *)ptr = val;
+	}
+
+	settingsDirty |= 1UL << id;
+	return true;
+}
+
+bool settingsSetString(setting_id_t id, const char *val)
+{
+	const setting_t& setting = settingsTable[id];
+	if(setting.type != SETTING_STRING || !settingsValid(id, val))
+		return false;
+
+	char *ptr = (char *)settingPtr(settings, setting);
+	if(strcmp(ptr, val) == 0)
+		return true;
+
+	strlcpy(ptr, val, setting.size);
+	settingsDirty |= 1UL << id;
+	return true;
+}
+
+uint32_t settingsGetUInt(setting_id_t id)
+{
+	const setting_t& setting = settingsTable[id];
+	void *ptr = settingPtr(settings, setting);
+	if(setting.type == SETTING_BOOL)
+		return *(bool *)ptr;
+	else
+		return *(uint8_t *)ptr;
+}
+
+const char *settingsGetString(setting_id_t id)
+{
+	return (const char *)settingPtr(settings, settingsTable[id]);
+}
+
+// writes all settings with a single flash operation, if any changed.
+// Settings are changed while holding stateMutex, committing them should
+// happen after releasing it to not block the main loop during the write.
+// Returns false if the write failed, the settings then stay dirty.
+bool settingsCommit()
+{
+	xSemaphoreTake(settingsCommitMutex, portMAX_DELAY);
+
+	if(settingsDirty != 0)
+	{
+		settings_blob_t blob;
+		memset(&blob, 0, sizeof(blob));
+		blob.version = SETTINGS_VERSION;
+		blob.settings = settings;
+
+		uint32_t committed = settingsDirty;
+		settingsDirty = 0;
+
+		if(preferences.putBytes(SETTINGS_BLOB_KEY, &blob, sizeof(blob)) != sizeof(blob))
+			settingsDirty |= committed;
+	}
+
+	bool success = settingsDirty == 0;
+	xSemaphoreGive(settingsCommitMutex);
+	return success;
+}
\ No newline at end of file
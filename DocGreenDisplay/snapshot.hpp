@@ -0,0 +1,212 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "state.hpp"
+#include "serializer.hpp"
+
+// Versioned snapshot of the status shown in the webinterface. Every change
+// of the decoded status bumps statusGeneration, the serialized forms are
+// rendered at most once per generation and shared by all clients.
+
+// status JSON of /data, including isLocked and the firmware update status
+#define DATA_JSON_MAX_LENGTH (STATUS_JSON_MAX_LENGTH + 128)
+// a server-sent event wrapping the status JSON: "data: <json>\n\n"
+#define DATA_EVENT_MAX_LENGTH (DATA_JSON_MAX_LENGTH + 8)
+// changes of the last generations kept for delta events, clients further
+// behind get all fields. Has to be a power of two.
+#define SNAPSHOT_CHANGES 128
+
+uint32_t statusGeneration = 0;
+
+typedef struct
+{
+	uint32_t fields;
+	bool extras;
+} snapshot_changes_t;
+
+template<size_t N>
+struct snapshot_cache_t
+{
+	uint32_t generation;
+	size_t length;
+	char data[N];
+};
+
+template<size_t N>
+struct snapshot_delta_cache_t : snapshot_cache_t<N>
+{
+	snapshot_changes_t changes;
+};
+
+static docgreen_status_t snapshotStatus;
+static bool snapshotLocked;
+static String snapshotUpdateStatus;
+// indexed by generation
+static snapshot_changes_t snapshotChanges[SNAPSHOT_CHANGES];
+static uint32_t snapshotBootId;
+static SemaphoreHandle_t snapshotMutex;
+
+static snapshot_cache_t<DATA_JSON_MAX_LENGTH> snapshotJsonCache;
+static snapshot_cache_t<STATUS_BINARY_MAX_LENGTH> snapshotBinaryCache;
+static snapshot_cache_t<DATA_EVENT_MAX_LENGTH> snapshotEventCache;
+static snapshot_delta_cache_t<DATA_EVENT_MAX_LENGTH> snapshotDeltaEventCache;
+
+// called after every decoded packet, bumps the generation if anything changed
+void snapshotUpdate(docgreen_status_t& status)
+{
+	uint32_t changed = statusFieldsChanged(status, snapshotStatus);
+	bool extras = isLocked != snapshotLocked || firmwareUpdateStatus != snapshotUpdateStatus;
+	if(statusGeneration == 0)
+	{
+		changed = STATUS_FIELDS_ALL;
+		extras = true;
+	}
+	else if(changed == 0 && !extras)
+	{
+		return;
+	}
+
+	xSemaphoreTake(snapshotMutex, portMAX_DELAY);
+	snapshotStatus = status;
+	snapshotLocked = isLocked;
+	if(extras)
+		snapshotUpdateStatus = firmwareUpdateStatus;
+
+	statusGeneration++;
+	snapshot_changes_t& changes = snapshotChanges[statusGeneration & (SNAPSHOT_CHANGES - 1)];
+	changes.fields = changed;
+	changes.extras = extras;
+	xSemaphoreGive(snapshotMutex);
+}
+
+void snapshotSetup(uint32_t bootId)
+{
+	// the boot id keeps ETags of different boots apart, the generation restarts at 1
+	snapshotBootId = bootId;
+	snapshotMutex = xSemaphoreCreateMutex();
+	snapshotUpdate(scooterStatus);
+}
+
+// holds snapshotMutex while rendering, snapshotUpdate runs in the main loop
+struct SnapshotLock
+{
+	SnapshotLock() { xSemaphoreTake(snapshotMutex, portMAX_DELAY); }
+	~SnapshotLock() { xSemaphoreGive(snapshotMutex); }
+};
+
+static size_t snapshotRenderJson(char *buff, size_t size, uint32_t mask, bool withExtras)
+{
+	json_writer_t writer;
+	jsonBegin(writer, buff, size);
+	serializeStatusJson(writer, snapshotStatus, mask);
+
+	if(withExtras)
+	{
+		jsonKey(writer, "isLocked");
+		jsonUInt(writer, snapshotLocked);
+		jsonKey(writer, "updateStatus");
+		jsonString(writer, snapshotUpdateStatus.c_str());
+	}
+
+	return jsonEnd(writer);
+}
+
+template<size_t N>
+static void snapshotRenderEvent(snapshot_cache_t<N>& cache, uint32_t mask, bool withExtras)
+{
+	memcpy(cache.data, "data: ", 6);
+	size_t len = snapshotRenderJson(cache.data + 6, N - 8, mask, withExtras);
+	if(len == 0)
+	{
+		cache.length = 0;
+		return;
+	}
+
+	len += 6;
+	cache.data[len++] = '\n';
+	cache.data[len++] = '\n';
+	cache.length = len;
+}
+
+// The getters below are only called from the webserver task, which is the
+// only one rendering into the caches. The returned data thus stays valid
+// until the next call, len is 0 when the data did not fit into the cache.
+
+const char *snapshotJson(size_t& len)
+{
+	SnapshotLock lock;
+	if(snapshotJsonCache.generation != statusGeneration)
+	{
+		snapshotJsonCache.length = snapshotRenderJson(snapshotJsonCache.data,
+			sizeof(snapshotJsonCache.data), STATUS_FIELDS_ALL, true);
+		snapshotJsonCache.generation = statusGeneration;
+	}
+
+	len = snapshotJsonCache.length;
+	return snapshotJsonCache.data;
+}
+
+const uint8_t *snapshotBinary(size_t& len)
+{
+	SnapshotLock lock;
+	if(snapshotBinaryCache.generation != statusGeneration)
+	{
+		snapshotBinaryCache.length = serializeStatusBinary((uint8_t *)snapshotBinaryCache.data,
+			sizeof(snapshotBinaryCache.data), snapshotStatus);
+		snapshotBinaryCache.generation = statusGeneration;
+	}
+
+	len = snapshotBinaryCache.length;
+	return (const uint8_t *)snapshotBinaryCache.data;
+}
+
+// the event bringing a client from lastGeneration to the current generation,
+// which is returned in generation as the main loop may bump statusGeneration
+// right after the lock is released. Clients up to SNAPSHOT_CHANGES generations
+// behind get only the fields changed since, as throttled clients usually miss
+// a few generations.
+const char *snapshotEvent(uint32_t lastGeneration, size_t& len, uint32_t& generation)
+{
+	SnapshotLock lock;
+	generation = statusGeneration;
+	if(lastGeneration != 0 && generation - lastGeneration < SNAPSHOT_CHANGES)
+	{
+		snapshot_changes_t changes = {0, false};
+		for(uint32_t i = lastGeneration + 1; i != generation + 1; i++)
+		{
+			changes.fields |= snapshotChanges[i & (SNAPSHOT_CHANGES - 1)].fields;
+			changes.extras |= snapshotChanges[i & (SNAPSHOT_CHANGES - 1)].extras;
+		}
+
+		// clients missing the same changes share the rendered event
+		snapshot_delta_cache_t<DATA_EVENT_MAX_LENGTH>& cache = snapshotDeltaEventCache;
+		if(cache.generation != generation || cache.changes.fields != changes.fields
+			|| cache.changes.extras != changes.extras)
+		{
+			snapshotRenderEvent(cache, changes.fields, changes.extras);
+			cache.generation = generation;
+			cache.changes = changes;
+		}
+
+		len = snapshotDeltaEventCache.length;
+		return snapshotDeltaEventCache.data;
+	}
+
+	if(snapshotEventCache.generation != generation)
+	{
+		snapshotRenderEvent(snapshotEventCache, STATUS_FIELDS_ALL, true);
+		snapshotEventCache.generation = generation;
+	}
+
+	len = snapshotEventCache.length;
+	return snapshotEventCache.data;
+}
+
+void snapshotETag(char *buff, size_t size)
+{
+	snprintf(buff, size, "\"%08lx-%lu\"", (unsigned long)snapshotBootId, (unsigned long)statusGeneration);
+}
\ No newline at end of file
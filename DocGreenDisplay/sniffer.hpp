@@ -0,0 +1,245 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <WiFi.h>
+#include <freertos/FreeRTOS.h>
+
+#include "config.h"
+#include "state.hpp"
+
+// Passive sniffer recording every frame seen by receivePacket, so production
+// units can capture intermittent controller errors. The last
+// SNIFFER_RING_SIZE frames are kept in a ring which always overwrites the
+// oldest frame, clients connecting to SNIFFER_PORT get the recorded frames
+// followed by new ones in the binary capture format of MegaSniffer:
+//   'D' 'G' flags (u8) timestamp (u32, micros) length (u16) data
+// e.g. `nc dashboard.local 82 > capture.bin` for SniffAnalyzer.
+//
+// The main loop only copies a frame into a slot once it is complete. Slots
+// are versioned (seqlock), the sniffer task detects slots overwritten while
+// it read them and skips them instead of blocking the main loop.
+
+#define SNIFFER_FLAG_BAD_CHECKSUM 0x01
+#define SNIFFER_FLAG_TRUNCATED 0x02 // longer than SNIFFER_FRAME_MAX or ended by a gap
+#define SNIFFER_FLAG_OVERFLOW 0x04 // frames were lost before this one
+
+#define SNIFFER_RECORD_HEADER_SIZE 9
+
+static_assert((SNIFFER_RING_SIZE & (SNIFFER_RING_SIZE - 1)) == 0,
+	"SNIFFER_RING_SIZE has to be a power of two.");
+
+typedef struct
+{
+	// 2 * index + 1 while written, 2 * index + 2 once complete
+	std::atomic<uint32_t> seq;
+	uint32_t time;
+	uint8_t flags;
+	uint8_t length;
+	uint8_t data[SNIFFER_FRAME_MAX];
+} sniffer_slot_t;
+
+static sniffer_slot_t snifferRing[SNIFFER_RING_SIZE];
+static std::atomic<uint32_t> snifferHead(0); // index of the next frame written
+
+// frame currently being received, only used by the main loop
+static struct
+{
+	uint8_t headerPos; // 55 AA bytes seen
+	uint16_t pos; // bytes after 55 AA
+	uint16_t sum;
+	uint16_t checksum;
+	uint32_t time;
+	uint32_t lastByte;
+	uint8_t length;
+	uint8_t data[SNIFFER_FRAME_MAX];
+} snifferFrame;
+
+static void snifferCommit(uint8_t flags)
+{
+	uint32_t index = snifferHead.load(std::memory_order_relaxed);
+	sniffer_slot_t& slot = snifferRing[index & (SNIFFER_RING_SIZE - 1)];
+
+	if(snifferFrame.pos > SNIFFER_FRAME_MAX)
+		flags |= SNIFFER_FLAG_TRUNCATED;
+	if((flags & SNIFFER_FLAG_TRUNCATED) || snifferFrame.checksum != (snifferFrame.sum ^ 0xFFFF))
+		flags |= SNIFFER_FLAG_BAD_CHECKSUM;
+
+	slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.time = snifferFrame.time;
+	slot.flags = flags;
+	slot.length = snifferFrame.length;
+	memcpy(slot.data, snifferFrame.data, snifferFrame.length);
+
+	slot.seq.store(2 * index + 2, std::memory_order_release);
+	snifferHead.store(index + 1, std::memory_order_release);
+}
+
+// called by receivePacket for every received byte
+void snifferByte(uint8_t val)
+{
+	if(!settings.snifferEnable)
+		return;
+
+	// keep what we got of a frame which stopped in the middle instead of
+	// trusting its length byte and swallowing the following frames
+	uint32_t now = micros();
+	if(snifferFrame.headerPos > 0 && now - snifferFrame.lastByte > SNIFFER_FRAME_GAP)
+	{
+		if(snifferFrame.headerPos == 2 && snifferFrame.pos > 0)
+			snifferCommit(SNIFFER_FLAG_TRUNCATED);
+		snifferFrame.headerPos = 0;
+	}
+	snifferFrame.lastByte = now;
+
+	if(snifferFrame.headerPos < 2)
+	{
+		if(val == 0x55)
+		{
+			snifferFrame.headerPos = 1;
+			snifferFrame.time = now;
+		}
+		else if(val == 0xAA && snifferFrame.headerPos == 1)
+		{
+			snifferFrame.headerPos = 2;
+			snifferFrame.pos = 0;
+			snifferFrame.sum = 0;
+			snifferFrame.length = 0;
+		}
+		else
+		{
+			snifferFrame.headerPos = 0;
+		}
+		return;
+	}
+
+	uint16_t pos = snifferFrame.pos++;
+	if(pos < SNIFFER_FRAME_MAX)
+		snifferFrame.data[snifferFrame.length++] = val;
+
+	// length, address and payload are followed by the checksum
+	uint16_t total = (uint16_t)snifferFrame.data[0] + 4;
+	if(pos + 2 < total)
+		snifferFrame.sum += val;
+	else if(pos + 2 == total)
+		snifferFrame.checksum = val;
+	else
+		snifferFrame.checksum |= (uint16_t)val << 8;
+
+	if(snifferFrame.pos == total)
+	{
+		snifferCommit(0);
+		snifferFrame.headerPos = 0;
+	}
+}
+
+//
+// streaming, runs in the webserver task
+//
+
+static WiFiServer snifferServer(SNIFFER_PORT);
+static WiFiClient snifferClient;
+static uint32_t snifferReadIndex;
+static bool snifferLost;
+
+// appends the record of frame index to buff, returns its length or 0 if the
+// frame was overwritten while reading it
+static size_t snifferReadRecord(uint32_t index, uint8_t *buff)
+{
+	sniffer_slot_t& slot = snifferRing[index & (SNIFFER_RING_SIZE - 1)];
+	uint32_t seq = slot.seq.load(std::memory_order_acquire);
+	if(seq != 2 * index + 2)
+		return 0;
+
+	uint8_t flags = slot.flags;
+	uint32_t time = slot.time;
+	uint8_t length = slot.length;
+	if(length > SNIFFER_FRAME_MAX)
+		return 0;
+	memcpy(buff + SNIFFER_RECORD_HEADER_SIZE, slot.data, length);
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if(slot.seq.load(std::memory_order_relaxed) != seq)
+		return 0;
+
+	buff[0] = 'D';
+	buff[1] = 'G';
+	buff[2] = flags;
+	memcpy(buff + 3, &time, sizeof(time)); // little endian like the ESP32
+	buff[7] = length;
+	buff[8] = 0;
+	return SNIFFER_RECORD_HEADER_SIZE + length;
+}
+
+static void snifferLoop()
+{
+	if(!snifferClient.connected())
+	{
+		WiFiClient client = snifferServer.available();
+		if(!client)
+			return;
+
+		if(!settings.snifferEnable)
+		{
+			client.stop();
+			return;
+		}
+
+		// start with everything still recorded
+		uint32_t head = snifferHead.load(std::memory_order_acquire);
+		snifferClient = client;
+		snifferReadIndex = head > SNIFFER_RING_SIZE ? head - SNIFFER_RING_SIZE : 0;
+		snifferLost = false;
+	}
+
+	static uint8_t buff[SNIFFER_SEND_BUFFER];
+	size_t len = 0;
+
+	uint32_t head = snifferHead.load(std::memory_order_acquire);
+	while(snifferReadIndex != head
+		&& len + SNIFFER_RECORD_HEADER_SIZE + SNIFFER_FRAME_MAX <= sizeof(buff))
+	{
+		// the main loop overtook us
+		if(head - snifferReadIndex > SNIFFER_RING_SIZE)
+		{
+			snifferReadIndex = head - SNIFFER_RING_SIZE;
+			snifferLost = true;
+		}
+
+		size_t recordLength = snifferReadRecord(snifferReadIndex, buff + len);
+		snifferReadIndex++;
+		if(recordLength == 0)
+		{
+			snifferLost = true;
+			continue;
+		}
+
+		if(snifferLost)
+			buff[len + 2] |= SNIFFER_FLAG_OVERFLOW;
+		snifferLost = false;
+		len += recordLength;
+	}
+
+	if(len > 0 && snifferClient.write(buff, len) != len)
+		snifferClient.stop();
+}
+
+// a slow client only stalls this task, not the webserver
+static void snifferTaskMain(void *arg)
+{
+	for(;;)
+	{
+		snifferLoop();
+		vTaskDelay(1);
+	}
+}
+
+void snifferBegin()
+{
+	snifferServer.begin();
+	xTaskCreatePinnedToCore(snifferTaskMain, "sniffer", SNIFFER_TASK_STACK,
+		NULL, SNIFFER_TASK_PRIORITY, NULL, SNIFFER_TASK_CORE);
+}
\ No newline at end of file
@@ -7,25 +7,99 @@
 // DocGreenDisplay.ino
 extern docgreen_status_t scooterStatus;
 extern Preferences preferences;
-#define PREFERENCE_MAX_SPEED "max-speed"
-#define PREFERENCE_SHOW_INTRO "show-intro"
-#define PREFERENCE_REENABLE_LIGHT "reenable-light"
-#define PREFERENCE_LOCK_ON_BOOT "lock-on-boot"
-#define PREFERENCE_LOCK_PIN "lock-pin"
-#define PREFERENCE_BLE_ENABLE "ble-enable"
-#define PREFERENCE_BLE_CONTROL_ENABLE "ble-ctrl-enable"
-#define PREFERENCE_AP_ENABLE "ap-enable"
-#define PREFERENCE_AP_SSID "ap-ssid"
-#define PREFERENCE_AP_PASSWORD "ap-pw"
-#define PREFERENCE_STA_ENABLE "sta-enable"
-#define PREFERENCE_STA_SSID "sta-ssid"
-#define PREFERENCE_STA_PASSWORD "sta-pw"
-#define PREFERENCE_UPDATE_URL "update-url"
+// guards state shared between the main loop and the webserver task
+extern SemaphoreHandle_t stateMutex;
+
+
+// settings.hpp
+typedef struct
+{
+	uint8_t maxSpeed;
+	bool showIntro;
+	bool reenableLight;
+	bool lockOnBoot;
+	char lockPin[17];
+	bool bleEnable;
+	bool bleControlEnable;
+	bool apEnable;
+	char apSsid[33];
+	char apPassword[65];
+	bool staEnable;
+	char staSsid[33];
+	char staPassword[65];
+	char updateUrl[129];
+	// new settings are only ever appended, see settingsLoad
+	bool fastBoot;
+	bool snifferEnable;
+} scooter_settings_t;
+
+typedef enum : uint8_t
+{
+	SETTING_MAX_SPEED,
+	SETTING_SHOW_INTRO,
+	SETTING_REENABLE_LIGHT,
+	SETTING_LOCK_ON_BOOT,
+	SETTING_LOCK_PIN,
+	SETTING_BLE_ENABLE,
+	SETTING_BLE_CONTROL_ENABLE,
+	SETTING_AP_ENABLE,
+	SETTING_AP_SSID,
+	SETTING_AP_PASSWORD,
+	SETTING_STA_ENABLE,
+	SETTING_STA_SSID,
+	SETTING_STA_PASSWORD,
+	SETTING_UPDATE_URL,
+	SETTING_FAST_BOOT,
+	SETTING_SNIFFER_ENABLE,
+	SETTING_COUNT,
+} setting_id_t;
+
+extern scooter_settings_t settings;
+bool settingsSetUInt(setting_id_t id, uint32_t val);
+bool settingsSetString(setting_id_t id, const char *val);
+bool settingsCommit();
+
+
+// boot.hpp
+typedef enum : uint8_t
+{
+	BOOT_SETUP,
+	BOOT_SETTINGS,
+	BOOT_FIRST_INPUT_FRAME,
+	BOOT_WIFI,
+	BOOT_OLED,
+	BOOT_WEBSERVER,
+	BOOT_BLUETOOTH,
+	BOOT_NETWORK_SERVICES,
+	BOOT_DONE,
+	BOOT_PHASE_COUNT,
+} boot_phase_t;
+
+extern uint32_t bootTimestamps[BOOT_PHASE_COUNT];
+void bootMark(boot_phase_t phase);
 
 
 // reenable-light.hpp
-extern bool reenableLightsAfterError;
 void internalSetLight(bool shouldBeOn);
+void rememberLightState(bool shouldBeOn);
+
+
+// commands.hpp
+typedef enum : uint8_t
+{
+	BUS_COMMAND_MAX_SPEED,
+	BUS_COMMAND_ECO_MODE,
+	BUS_COMMAND_LOCK,
+	BUS_COMMAND_LIGHT,
+} bus_command_type_t;
+
+typedef struct
+{
+	bus_command_type_t type;
+	uint8_t value;
+} bus_command_t;
+
+bool queueBusCommand(bus_command_type_t type, uint8_t value);
 
 
 // oled-ui.hpp
@@ -38,26 +112,34 @@ void internalSetLight(bool shouldBeOn);
 extern uint8_t pressedButtons;
 uint8_t getAndResetButtons();
 
-extern uint32_t configuredSpeed;
-
-extern String scooterPin;
 extern bool isLocked;
+extern volatile bool oledUiReady;
 
 
 // wifi.hpp
 extern bool wifiApEnabled;
 extern bool wifiStaEnabled;
-extern String wifiApSsid;
-extern String wifiApPassword;
-extern String wifiStaSsid;
-extern String wifiStaPassword;
 
 
 // bluetooth.hpp
-extern bool bluetoothControlEnabled;
+typedef struct
+{
+	uint32_t received;
+	uint32_t dropped; // ring full or request too long
+	uint16_t depth;
+	uint16_t maxDepth;
+	uint32_t lastLatency; // microseconds from onWrite until the response
+	uint32_t maxLatency;
+} ble_request_stats_t;
+
+extern ble_request_stats_t bleRequestStats;
 
 
 // update.hpp
-extern String firmwareUpdateUrl;
 extern String firmwareUpdateStatus;
-extern void checkForFirmwareUpdates();
\ No newline at end of file
+bool startFirmwareUpdate();
+void cancelFirmwareUpdate();
+bool firmwareUploadBegin();
+void firmwareUploadWrite(const uint8_t *data, size_t len);
+void firmwareUploadAbort();
+const char *firmwareUploadEnd(const char *expectedHash, char digest[65]);
\ No newline at end of file
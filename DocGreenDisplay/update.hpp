@@ -1,10 +1,15 @@
 #include <WiFi.h>
-#include <HTTPUpdate.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include <Update.h>
 #include <time.h>
-#include <thread>
+#include <stdarg.h>
+#include <freertos/FreeRTOS.h>
+#include <mbedtls/sha256.h>
 
 #include "config.h"
 #include "state.hpp"
+#include "delta.hpp"
 
 // see: https://letsencrypt.org/certificates/
 // direct link: https://letsencrypt.org/certs/lets-encrypt-x3-cross-signed.pem.txt
@@ -37,46 +42,472 @@ const char *letsEncryptX3RootCa = \
 "KOqkqm57TH2H3eDJAkSnh6/DNFu0Qg==\n" \
 "-----END CERTIFICATE-----\n";
 
-String firmwareUpdateUrl;
 String firmwareUpdateStatus = "uninitialized";
 
-void checkForFirmwareUpdates()
+// set before the update task is created and cleared by the task itself, so
+// it never outlives the task even if the task finishes before being tracked
+static volatile bool firmwareUpdateRunning = false;
+static volatile bool firmwareUpdateCancelled = false;
+
+// firmwareUpdateStatus is read by the main loop, only replace it while holding stateMutex
+static void setFirmwareUpdateStatus(const char *format, ...)
+{
+	char buff[64];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buff, sizeof(buff), format, args);
+	va_end(args);
+
+	xSemaphoreTake(stateMutex, portMAX_DELAY);
+	firmwareUpdateStatus = buff;
+	xSemaphoreGive(stateMutex);
+}
+
+static bool waitForNtp()
 {
-	// wait for time from NTP server
-	time_t now = time(nullptr);
-	int ntpWait = 0;
-	while(now < 8 * 3600 * 2)
+	// the certificate can't be validated without the current time
+	uint32_t start = millis();
+	while(time(nullptr) < 8 * 3600 * 2)
 	{
-		ntpWait++;
-		if(ntpWait > 20)
+		if(firmwareUpdateCancelled)
 		{
-			firmwareUpdateStatus = "NTP timeout";
-			return;
+			setFirmwareUpdateStatus("cancelled");
+			return false;
+		}
+		if(millis() - start > OTA_NTP_TIMEOUT)
+		{
+			setFirmwareUpdateStatus("NTP timeout");
+			return false;
 		}
 
-		delay(500);
-		now = time(nullptr);
+		vTaskDelay(pdMS_TO_TICKS(500));
 	}
 
-	WiFiClientSecure client;
-	client.setCACert(letsEncryptX3RootCa);
-	client.setTimeout(10);
+	return true;
+}
+
+//
+// image writer
+//
+// Downloads and uploads are either full images or deltas against the running
+// firmware (see delta.hpp), which is detected by the first bytes written.
+// Only one update can be written at a time.
+//
+
+static volatile bool firmwareImageActive = false;
+static portMUX_TYPE firmwareImageMux = portMUX_INITIALIZER_UNLOCKED;
+static bool firmwareImageStarted;
+static bool firmwareImageIsDelta;
+static size_t firmwareImageSize;
+static uint8_t firmwareImageHeader[4]; // the first bytes, which may be DELTA_MAGIC
+static uint8_t firmwareImageHeaderLength;
+static delta_patcher_t firmwarePatcher;
+
+// size is the size of a full image or UPDATE_SIZE_UNKNOWN, returns false if
+// another update is being written
+static bool firmwareImageBegin(size_t size)
+{
+	portENTER_CRITICAL(&firmwareImageMux);
+	bool busy = firmwareImageActive;
+	firmwareImageActive = true;
+	portEXIT_CRITICAL(&firmwareImageMux);
+
+	if(busy)
+		return false;
+
+	firmwareImageStarted = false;
+	firmwareImageIsDelta = false;
+	firmwareImageSize = size;
+	firmwareImageHeaderLength = 0;
+	return true;
+}
+
+static const char *firmwareImagePut(const uint8_t *data, size_t len)
+{
+	if(firmwareImageIsDelta)
+		return deltaWrite(firmwarePatcher, data, len) ? NULL : firmwarePatcher.error;
+	else if(Update.write((uint8_t *)data, len) != len)
+		return Update.errorString();
+
+	return NULL;
+}
 
-	httpUpdate.rebootOnUpdate(false);
-	t_httpUpdate_return ret = httpUpdate.update(client, firmwareUpdateUrl);
+// decides between a delta and a full image and writes the buffered header
+static const char *firmwareImageStart()
+{
+	firmwareImageStarted = true;
+	firmwareImageIsDelta = firmwareImageHeaderLength == sizeof(firmwareImageHeader)
+		&& memcmp(firmwareImageHeader, DELTA_MAGIC, sizeof(firmwareImageHeader)) == 0;
+
+	if(firmwareImageIsDelta)
+		deltaBegin(firmwarePatcher);
+	else if(!Update.begin(firmwareImageSize))
+		return Update.errorString();
+
+	return firmwareImagePut(firmwareImageHeader, firmwareImageHeaderLength);
+}
+
+// returns an error or NULL on success
+static const char *firmwareImageWrite(const uint8_t *data, size_t len)
+{
+	if(!firmwareImageStarted)
+	{
+		// chunks can be shorter than the magic, e.g. the first TCP segment
+		size_t copy = sizeof(firmwareImageHeader) - firmwareImageHeaderLength;
+		if(copy > len)
+			copy = len;
+
+		memcpy(firmwareImageHeader + firmwareImageHeaderLength, data, copy);
+		firmwareImageHeaderLength += copy;
+		data += copy;
+		len -= copy;
+		if(firmwareImageHeaderLength < sizeof(firmwareImageHeader))
+			return NULL;
+
+		const char *error = firmwareImageStart();
+		if(error != NULL)
+			return error;
+	}
+
+	return len == 0 ? NULL : firmwareImagePut(data, len);
+}
+
+static void firmwareImageAbort()
+{
+	if(firmwareImageIsDelta)
+		deltaFree(firmwarePatcher);
+	if(Update.isRunning())
+		Update.abort();
+
+	firmwareImageActive = false;
+}
+
+// verifies the image and switches the boot partition, returns an error or NULL on success
+static const char *firmwareImageEnd()
+{
+	const char *error = NULL;
+	if(!firmwareImageStarted && firmwareImageHeaderLength == 0)
+		error = "empty image";
+	else if(!firmwareImageStarted)
+		error = firmwareImageStart(); // shorter than the header, Update rejects it
+	else if(firmwareImageIsDelta)
+		error = deltaEnd(firmwarePatcher);
 
-	if(ret == HTTP_UPDATE_OK)
-		firmwareUpdateStatus = "success, please restart";
-	else if(ret == HTTP_UPDATE_NO_UPDATES)
-		firmwareUpdateStatus = "no updates";
+	if(error == NULL && !Update.end(true))
+		error = Update.errorString();
+
+	if(error != NULL)
+		firmwareImageAbort();
 	else
-		firmwareUpdateStatus = "error: " + httpUpdate.getLastErrorString();
+		firmwareImageActive = false;
+
+	return error;
 }
 
-void setupFirmwareUpdate()
+//
+// download
+//
+
+static const char firmwareErrorNotFound[] = "image not found";
+
+// <name>.bin is looked up as <name>.<md5 of the running image>.delta
+static void deltaUpdateUrl(char *buff, size_t size, const char *url)
+{
+	String md5 = ESP.getSketchMD5();
+	int len = strlen(url);
+	if(len > 4 && strcmp(url + len - 4, ".bin") == 0)
+		len -= 4;
+
+	snprintf(buff, size, "%.*s.%s.delta", len, url, md5.c_str());
+}
+
+// streams the image into the inactive partition, returns an error or NULL on success
+static const char *downloadFirmwareImage(HTTPClient& http)
+{
+	// the server answers 304 if this already is the newest image
+	http.addHeader("x-ESP32-sketch-md5", ESP.getSketchMD5());
+
+	int code = http.GET();
+	if(code == HTTP_CODE_NOT_MODIFIED)
+		return "no updates";
+	else if(code == HTTP_CODE_NOT_FOUND)
+		return firmwareErrorNotFound;
+	else if(code < 0)
+		return "connection failed";
+	else if(code != HTTP_CODE_OK)
+		return "unexpected HTTP status";
+
+	int size = http.getSize();
+	if(size <= 0)
+		return "unknown image size";
+
+	size_t total = size;
+	if(!firmwareImageBegin(total))
+		return "update already running";
+
+	static uint8_t buff[OTA_BUFFER_SIZE];
+	WiFiClient *stream = http.getStreamPtr();
+	uint32_t start = millis();
+	uint32_t lastData = start;
+	uint32_t lastStatus = start;
+	size_t done = 0;
+
+	while(done < total)
+	{
+		uint32_t now = millis();
+		if(firmwareUpdateCancelled)
+		{
+			firmwareImageAbort();
+			return "cancelled";
+		}
+
+		size_t len = stream->available();
+		if(len == 0)
+		{
+			if(!stream->connected() || now - lastData > OTA_READ_TIMEOUT)
+			{
+				firmwareImageAbort();
+				return "connection lost";
+			}
+
+			vTaskDelay(1);
+			continue;
+		}
+
+		if(len > sizeof(buff))
+			len = sizeof(buff);
+		if(len > total - done)
+			len = total - done;
+
+		len = stream->readBytes(buff, len);
+		const char *error = firmwareImageWrite(buff, len);
+		if(error != NULL)
+		{
+			firmwareImageAbort();
+			return error;
+		}
+
+		done += len;
+		lastData = now;
+
+		if(now - lastStatus >= OTA_STATUS_INTERVAL)
+		{
+			// bytes per millisecond equal kB/s
+			uint32_t elapsed = now - start;
+			setFirmwareUpdateStatus("%u / %u kB, %lu kB/s", (unsigned)(done / 1000), (unsigned)(total / 1000),
+				(unsigned long)(elapsed == 0 ? 0 : done / elapsed));
+			lastStatus = now;
+		}
+	}
+
+	return firmwareImageEnd();
+}
+
+static const char *downloadFirmwareUpdate(WiFiClient& client, const char *url)
+{
+	HTTPClient http;
+	const char *error;
+	if(http.begin(client, url))
+		error = downloadFirmwareImage(http);
+	else
+		error = "invalid URL";
+
+	http.end();
+	return error;
+}
+
+static void firmwareUpdateTaskMain(void *arg)
 {
-	firmwareUpdateUrl = preferences.getString(PREFERENCE_UPDATE_URL, DEFAULT_UPDATE_URL);
+	if(waitForNtp())
+	{
+		setFirmwareUpdateStatus("connecting");
+
+		WiFiClientSecure client;
+		client.setCACert(letsEncryptX3RootCa);
+		client.setTimeout(10);
+
+		// a delta against the running firmware is only a fraction of the full image
+		char deltaUrl[sizeof(settings.updateUrl) + 40];
+		deltaUpdateUrl(deltaUrl, sizeof(deltaUrl), settings.updateUrl);
+
+		const char *error = downloadFirmwareUpdate(client, deltaUrl);
+		if(error == firmwareErrorNotFound || error == deltaErrorBaseMismatch)
+		{
+			setFirmwareUpdateStatus("downloading full image");
+			error = downloadFirmwareUpdate(client, settings.updateUrl);
+		}
+
+		if(error == NULL)
+			setFirmwareUpdateStatus("success, please restart");
+		else if(firmwareUpdateCancelled)
+			setFirmwareUpdateStatus("cancelled");
+		else
+			setFirmwareUpdateStatus("error: %s", error);
+	}
+
+	firmwareUpdateRunning = false;
+	vTaskDelete(NULL);
+}
+
+// Downloads run in their own low priority task on the core not running the
+// main loop, so ScooterSerial keeps being served during the update.
+bool startFirmwareUpdate()
+{
+	if(!wifiStaEnabled || firmwareUpdateRunning || firmwareImageActive)
+		return false;
+
+	firmwareUpdateRunning = true;
+	firmwareUpdateCancelled = false;
+	setFirmwareUpdateStatus("starting");
+
+	if(xTaskCreatePinnedToCore(firmwareUpdateTaskMain, "update", OTA_TASK_STACK,
+		NULL, OTA_TASK_PRIORITY, NULL, OTA_TASK_CORE) != pdPASS)
+	{
+		firmwareUpdateRunning = false;
+		setFirmwareUpdateStatus("error: out of memory");
+		return false;
+	}
+
+	return true;
+}
+
+void cancelFirmwareUpdate()
+{
+	if(firmwareUpdateRunning)
+		firmwareUpdateCancelled = true;
+}
+
+//
+// local upload
+//
+// Images or deltas uploaded through the webserver are written in the chunks
+// the webserver receives them in, while a SHA-256 is computed over the
+// stream. The boot partition is only switched when the image is complete
+// and its hash matches the one sent by the client.
+//
+
+static mbedtls_sha256_context firmwareUploadHash;
+static bool firmwareUploadHashing = false;
+static bool firmwareUploadActive = false; // the upload is writing the image
+static const char *firmwareUploadError = NULL;
+static size_t firmwareUploadSize;
+static uint32_t firmwareUploadStart;
+static uint32_t firmwareUploadLastStatus;
+
+static void firmwareUploadAbortImage()
+{
+	if(firmwareUploadActive)
+		firmwareImageAbort();
+	firmwareUploadActive = false;
+}
+
+static void firmwareUploadFreeHash()
+{
+	// the hash may hold the SHA hardware, always release it
+	if(firmwareUploadHashing)
+		mbedtls_sha256_free(&firmwareUploadHash);
+	firmwareUploadHashing = false;
+}
+
+bool firmwareUploadBegin()
+{
+	firmwareUploadSize = 0;
+	firmwareUploadStart = millis();
+	firmwareUploadLastStatus = firmwareUploadStart;
+
+	if(!firmwareImageBegin(UPDATE_SIZE_UNKNOWN))
+	{
+		firmwareUploadError = "update already running";
+		return false;
+	}
 
+	firmwareUploadActive = true;
+	mbedtls_sha256_init(&firmwareUploadHash);
+	mbedtls_sha256_starts(&firmwareUploadHash, 0);
+	firmwareUploadHashing = true;
+	firmwareUploadError = NULL;
+	setFirmwareUpdateStatus("uploading");
+	return true;
+}
+
+void firmwareUploadWrite(const uint8_t *data, size_t len)
+{
+	if(firmwareUploadError != NULL || !firmwareUploadActive)
+		return;
+
+	mbedtls_sha256_update(&firmwareUploadHash, data, len);
+	const char *error = firmwareImageWrite(data, len);
+	if(error != NULL)
+	{
+		firmwareUploadError = error;
+		firmwareUploadAbortImage();
+		setFirmwareUpdateStatus("error: %s", firmwareUploadError);
+		return;
+	}
+
+	firmwareUploadSize += len;
+
+	uint32_t now = millis();
+	if(now - firmwareUploadLastStatus >= OTA_STATUS_INTERVAL)
+	{
+		uint32_t elapsed = now - firmwareUploadStart;
+		setFirmwareUpdateStatus("uploaded %u kB, %lu kB/s", firmwareUploadSize / 1000,
+			(unsigned long)(elapsed == 0 ? 0 : firmwareUploadSize / elapsed));
+		firmwareUploadLastStatus = now;
+	}
+}
+
+void firmwareUploadAbort()
+{
+	firmwareUploadAbortImage();
+	firmwareUploadFreeHash();
+	firmwareUploadError = "upload aborted";
+	setFirmwareUpdateStatus("error: %s", firmwareUploadError);
+}
+
+// expectedHash is the hex SHA-256 of the image, digest receives the hex
+// SHA-256 of the received data. Returns an error or NULL on success.
+const char *firmwareUploadEnd(const char *expectedHash, char digest[65])
+{
+	digest[0] = 0;
+	if(firmwareUploadError == NULL && !firmwareUploadHashing)
+		firmwareUploadError = "no image uploaded";
+	if(firmwareUploadError != NULL)
+	{
+		firmwareUploadAbortImage();
+		firmwareUploadFreeHash();
+		return firmwareUploadError;
+	}
+
+	uint8_t hash[32];
+	mbedtls_sha256_finish(&firmwareUploadHash, hash);
+	firmwareUploadFreeHash();
+	for(uint8_t i = 0; i < sizeof(hash); i++)
+		sprintf(digest + i * 2, "%02x", hash[i]);
+
+	if(expectedHash[0] == 0 || strcasecmp(expectedHash, digest) != 0)
+	{
+		firmwareUploadError = expectedHash[0] == 0 ? "sha256 missing" : "hash mismatch";
+		firmwareImageAbort();
+	}
+	else
+	{
+		firmwareUploadError = firmwareImageEnd();
+	}
+	firmwareUploadActive = false;
+
+	if(firmwareUploadError != NULL)
+	{
+		setFirmwareUpdateStatus("error: %s", firmwareUploadError);
+		return firmwareUploadError;
+	}
+
+	setFirmwareUpdateStatus("success, please restart");
+	return NULL;
+}
+
+void setupFirmwareUpdate()
+{
 	if(!wifiStaEnabled)
 	{
 		firmwareUpdateStatus = "no internet";
@@ -84,4 +515,4 @@ void setupFirmwareUpdate()
 	}
 
 	firmwareUpdateStatus = "not started";
-}
+}
\ No newline at end of file
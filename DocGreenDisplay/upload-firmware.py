@@ -0,0 +1,41 @@
+import sys, time, hashlib, urllib.request, uuid
+
+# Uploads a firmware image to the /upload endpoint of the dashboard, e.g.
+# while connected to its access point:
+#   python3 upload-firmware.py 192.168.4.1 DocGreenDisplay.ino.esp32.bin
+# Deltas generated by make-delta.py are uploaded the same way. Prints the
+# throughput and the minimum free heap reported by the dashboard.
+
+if len(sys.argv) != 3:
+    print("usage: {} <host> <firmware.bin>".format(sys.argv[0]))
+    sys.exit(1)
+
+host, path = sys.argv[1:]
+with open(path, "rb") as fd:
+    image = fd.read()
+
+digest = hashlib.sha256(image).hexdigest()
+boundary = uuid.uuid4().hex
+body = b"".join([
+    "--{}\r\n".format(boundary).encode(),
+    b"Content-Disposition: form-data; name=\"firmware\"; filename=\"firmware.bin\"\r\n",
+    b"Content-Type: application/octet-stream\r\n\r\n",
+    image,
+    "\r\n--{}--\r\n".format(boundary).encode(),
+])
+
+request = urllib.request.Request("http://{}/upload?sha256={}".format(host, digest), data=body)
+request.add_header("Content-Type", "multipart/form-data; boundary={}".format(boundary))
+
+start = time.time()
+try:
+    with urllib.request.urlopen(request) as res:
+        response = res.read().decode()
+except urllib.error.HTTPError as err:
+    response = err.read().decode()
+duration = time.time() - start
+
+print(response.strip())
+print("uploaded {} bytes in {:.1f} s ({:.1f} kB/s)".format(
+    len(image), duration, len(image) / duration / 1000))
+print("local sha256: {}".format(digest))
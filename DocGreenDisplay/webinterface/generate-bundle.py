@@ -1,38 +1,111 @@
-import os, re, gzip
+import os, re, gzip, hashlib
 
-with open("index.html") as fd:
-    template = fd.read()
+# Generates bundle.hpp containing a table of all assets of the webinterface.
+# Every asset is minified and gzipped, scripts and styles get the hash of
+# their content in their name so the browser can cache them forever.
+# bundle.html is a single file version of the webinterface for local testing.
+# %streamPort% in scripts is replaced with STREAM_PORT of config.h.
+
+MIME_TYPES = {
+    ".html": "text/html",
+    ".js": "application/javascript",
+    ".css": "text/css",
+}
+
+def minifyJs(code):
+    # conservative: only drops indentation, full line comments and empty lines
+    lines = []
+    for line in code.splitlines():
+        line = line.strip()
+        if line == "" or line.startswith("//"):
+            continue
+        lines.append(line)
+    return "\n".join(lines)
+
+def minifyCss(code):
+    code = re.sub("/\\*.*?\\*/", "", code, flags=re.S)
+    code = re.sub("\\s+", " ", code)
+    code = re.sub(" ?([{}:;,]) ?", "\\1", code)
+    return code.strip()
+
+def minifyHtml(code):
+    return re.sub(">\\s+<", "><", code).strip()
+
+def contentHash(data):
+    return hashlib.sha256(data).hexdigest()[:16]
 
 path = os.path.abspath(__file__)
 path = os.path.dirname(path)
-files = os.listdir(path)
+files = sorted(os.listdir(path))
+
+with open(os.path.join(path, "index.html")) as fd:
+    template = fd.read()
 
+with open(os.path.join(path, "..", "config.h")) as fd:
+    streamPort = re.search("#define STREAM_PORT (\\d+)", fd.read()).group(1)
+
+assets = []
+scriptTags = ""
+styleTags = ""
 jsCode = ""
 cssCode = ""
 for filename in files:
-    with open(filename) as fd:
+    name, ext = os.path.splitext(filename)
+    if ext not in (".js", ".css"):
+        continue
+
+    with open(os.path.join(path, filename)) as fd:
         content = fd.read()
 
-    if filename.endswith(".js"):
+    if ext == ".js":
+        content = content.replace("%streamPort%", streamPort)
         jsCode += content + "\n"
-    if filename.endswith(".css"):
+        content = minifyJs(content)
+    else:
         cssCode += content + "\n"
+        content = minifyCss(content)
+
+    data = content.encode("utf8")
+    assetPath = "/{}.{}{}".format(name, contentHash(data)[:8], ext)
+    assets.append((assetPath, MIME_TYPES[ext], data, True))
+
+    if ext == ".js":
+        scriptTags += "<script src=\"{}\"></script>".format(assetPath)
+    else:
+        styleTags += "<link rel=\"stylesheet\" href=\"{}\">".format(assetPath)
+
+index = template.replace("<style>%css%/**/</style>", styleTags)
+index = index.replace("<script>%js%</script>", scriptTags)
+assets.insert(0, ("/", MIME_TYPES[".html"], minifyHtml(index).encode("utf8"), False))
+
+bundle = template.replace("%js%", jsCode)
+bundle = bundle.replace("%css%", cssCode)
+with open(os.path.join(path, "bundle.html"), "w") as fd:
+    fd.write(bundle)
+
+with open(os.path.join(path, "bundle.hpp"), "w") as fd:
+    fd.write("#pragma once\n#include <stdint.h>\n\n//autogenerated by generate-bundle.py\n\n")
+    fd.write("typedef struct\n{\n\tconst char *path;\n\tconst char *mimeType;\n")
+    fd.write("\tconst uint8_t *data; // gzipped\n\tuint32_t length;\n\tconst char *etag;\n")
+    fd.write("\tbool immutable; // path contains the content hash\n} web_asset_t;\n\n")
 
-template = template.replace("%js%", jsCode)    
-template = template.replace("%css%", cssCode)
+    table = ""
+    for i, (assetPath, mimeType, data, immutable) in enumerate(assets):
+        compressed = gzip.compress(data, mtime=0)
 
-#template = re.sub("\\s+", " ", template)
-compressed = gzip.compress(template.encode("utf8"))
+        fd.write("// {}: {} bytes of gzipped {} (uncompressed: {} bytes)\n"
+            .format(assetPath, len(compressed), mimeType, len(data)))
+        fd.write("const uint8_t webAsset{}[] PROGMEM = {{\n".format(i))
+        for j, val in enumerate(compressed):
+            fd.write("{0:#04x}, ".format(val))
+            if j % 16 == 15:
+                fd.write("\n")
+        fd.write("\n};\n\n")
 
-with open("bundle.html", "w") as fd:
-    fd.write(template)
+        table += "\t{{\"{}\", \"{}\", webAsset{}, {}, \"\\\"{}\\\"\", {}}},\n".format(
+            assetPath, mimeType, i, len(compressed), contentHash(compressed),
+            "true" if immutable else "false")
 
-with open("bundle.hpp", "w") as fd:
-    fd.write("#pragma once\n#include <stdint.h>\n\n//autogenerated by generate-bundle.py\n")
-    fd.write("//{} bytes of gzipped html (uncompressed: {} bytes)\n".format(len(compressed), len(template)))
-    fd.write("const uint8_t webpageData[] PROGMEM = {\n")
-    for i, val in enumerate(compressed):
-        fd.write("{0:#04x}, ".format(val))
-        if i % 16 == 15:
-            fd.write("\n")
-    fd.write("\n};\n//end")
+    fd.write("const web_asset_t webAssets[] = {\n")
+    fd.write(table)
+    fd.write("};\n//end")
@@ -131,62 +131,92 @@ document.body.onload = function()
 		barStartPosition: 'right',
 	});
 
-	function updateData()
+	var data = {};
+	function applyData(update)
 	{
-		return fetch('/data')
-			.then(res => res.json())
-			.then(data => {
+		Object.assign(data, update);
 
-				if(statusSpanTimeout > 0)
-				{
-					statusSpanTimeout--;
-				}
-				else
-				{
-					isLightOn = !!data.lights;
-					isEcoModeOn = !!data.ecoMode;
-					isLockOn = !!data.isLocked;
-
-					updateStatusSpan("light-status", isLightOn);
-					updateStatusSpan("eco-status", isEcoModeOn);
-					updateStatusSpan("lock-status", isLockOn);
-				}
-
-				speedGauge.value = data.speed / 1000;
-				batteryGauge.value = data.soc;
-
-				var throttle = data.throttle;
-				var brake = data.brake;
-				if(brake > throttle)
-					accelerationGauge.value = -1 * (brake - 0x2C) / (0xB5 - 0x2C);
-				else
-					accelerationGauge.value = (throttle - 0x2C) / (0xC5 - 0x2C);
+		if(statusSpanTimeout < Date.now())
+		{
+			isLightOn = !!data.lights;
+			isEcoModeOn = !!data.ecoMode;
+			isLockOn = !!data.isLocked;
+
+			updateStatusSpan("light-status", isLightOn);
+			updateStatusSpan("eco-status", isEcoModeOn);
+			updateStatusSpan("lock-status", isLockOn);
+		}
+
+		speedGauge.value = data.speed / 1000;
+		batteryGauge.value = data.soc;
 
-				for(var key in data)
-				{
-					var el = document.getElementById("stat-" + key);
-					if(!el)
-						continue;
+		var throttle = data.throttle;
+		var brake = data.brake;
+		if(brake > throttle)
+			accelerationGauge.value = -1 * (brake - 0x2C) / (0xB5 - 0x2C);
+		else
+			accelerationGauge.value = (throttle - 0x2C) / (0xC5 - 0x2C);
 
-					var val = data[key];
-					if(el.dataset.scale == "time")
-						val = `${val / (60 * 60) | 0}h ${(val / 60) % 60 | 0}min ${val % 60}s`;
-					else if(!isNaN(el.dataset.scale))
-						val = val * parseFloat(el.dataset.scale);
+		for(var key in update)
+		{
+			var el = document.getElementById("stat-" + key);
+			if(!el)
+				continue;
 
-					el.innerText = val;
-				}
+			var val = data[key];
+			if(el.dataset.scale == "time")
+				val = `${val / (60 * 60) | 0}h ${(val / 60) % 60 | 0}min ${val % 60}s`;
+			else if(!isNaN(el.dataset.scale))
+				val = val * parseFloat(el.dataset.scale);
+
+			el.innerText = val;
+		}
+	}
 
-			})
+	function updateData()
+	{
+		return fetch('/data')
+			.then(res => res.json())
+			.then(applyData)
 			.catch(handleError)
 			.then(() => setTimeout(updateData, 200));
 	}
 
+	// the dashboard pushes changed fields as server-sent events on
+	// STREAM_PORT, fall back to polling /data when the stream is not available
+	function streamData()
+	{
+		if(!window.EventSource)
+			return updateData();
+
+		var hadData = false;
+		var source = new EventSource("http://" + location.hostname + ":%streamPort%/");
+		source.onmessage = function(ev)
+		{
+			hadData = true;
+			applyData(JSON.parse(ev.data));
+		};
+		source.onerror = function(err)
+		{
+			if(hadData)
+				return; // EventSource reconnects by itself
+
+			source.close();
+			handleError(err);
+			updateData();
+		};
+
+		return fetch('/data')
+			.then(res => res.json())
+			.then(applyData)
+			.catch(handleError);
+	}
+
 	speedGauge.draw();
 	batteryGauge.draw();
 	accelerationGauge.draw();
 
-	updateData()
+	streamData()
 		.then(() => updateConfig());
 };
 
@@ -290,27 +320,118 @@ function toggleLight()
 {
 	doAction("setLight", !isLightOn);
 	updateStatusSpan("light-status", !isLightOn);
-	statusSpanTimeout = 3;
+	statusSpanTimeout = Date.now() + 600;
 }
 function toggleEcoMode()
 {
 	doAction("setEcoMode", !isEcoModeOn);
 	updateStatusSpan("eco-status", !isEcoModeOn);
-	statusSpanTimeout = 3;
+	statusSpanTimeout = Date.now() + 600;
 }
 function toggleLock()
 {
 	doAction("setLock", !isLockOn);
 	updateStatusSpan("lock-status", !isLockOn);
-	statusSpanTimeout = 3;
+	statusSpanTimeout = Date.now() + 600;
 }
 
 function startFirmwareUpdate()
 {
-	if(!confirm("The Scooter will become unresponsive until the update is finished!"))
+	if(!confirm("Download and install the latest firmware?"))
 		return;
 
 	fetch("/updateFirmware")
+		.then(res => res.ok
+			? Promise.resolve()
+			: Promise.reject(new Error('non 200 response code'))
+		)
 		.then(() => document.getElementById("stat-updateStatus").innerText = "running...")
 		.catch(handleError)
 }
+function cancelFirmwareUpdate()
+{
+	fetch("/cancelFirmwareUpdate")
+		.catch(handleError)
+}
+// SHA-256 of an ArrayBuffer as hex string, crypto.subtle is only available in
+// secure contexts and the dashboard is served over plain http
+function sha256Hex(buffer)
+{
+	var k = [
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+	];
+	var h = [0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19];
+
+	// padding, 0x80 and the length in bits as 64 bit big endian
+	var len = buffer.byteLength;
+	var data = new Uint8Array(((len + 9 + 63) >> 6) << 6);
+	data.set(new Uint8Array(buffer));
+	data[len] = 0x80;
+	var view = new DataView(data.buffer);
+	view.setUint32(data.length - 8, Math.floor(len / 0x20000000));
+	view.setUint32(data.length - 4, (len << 3) >>> 0);
+
+	var rotr = (x, n) => (x >>> n) | (x << (32 - n));
+	var w = new Uint32Array(64);
+	for(var offset = 0; offset < data.length; offset += 64)
+	{
+		for(var i = 0; i < 16; i++)
+			w[i] = view.getUint32(offset + i * 4);
+		for(var i = 16; i < 64; i++)
+		{
+			var s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >>> 3);
+			var s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >>> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		var [a, b, c, d, e, f, g, hh] = h;
+		for(var i = 0; i < 64; i++)
+		{
+			var t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+			var t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			hh = g;
+			g = f;
+			f = e;
+			e = (d + t1) | 0;
+			d = c;
+			c = b;
+			b = a;
+			a = (t1 + t2) | 0;
+		}
+
+		h = [a, b, c, d, e, f, g, hh].map((x, i) => (x + h[i]) | 0);
+	}
+
+	return h.map(x => (x >>> 0).toString(16).padStart(8, '0')).join('');
+}
+function uploadFirmware()
+{
+	var file = document.getElementById("firmware-file").files[0];
+	if(!file)
+		return;
+
+	// the dashboard only switches to images whose hash matches
+	var status = document.getElementById("stat-updateStatus");
+	status.innerText = "hashing...";
+	file.arrayBuffer()
+		.then(buffer => {
+			var form = new FormData();
+			form.append("firmware", file);
+
+			status.innerText = "uploading...";
+			return fetch("/upload?sha256=" + sha256Hex(buffer), {
+				method: 'POST',
+				body: form,
+			});
+		})
+		.then(res => res.text())
+		.then(text => document.getElementById("stat-updateStatus").innerText = text.split("\n")[0])
+		.catch(handleError);
+}
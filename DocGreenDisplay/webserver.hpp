@@ -3,131 +3,272 @@
 #include <WebServer.h>
 #include <ESPmDNS.h>
 
+#include "config.h"
 #include "state.hpp"
 #include "protocol.h"
+#include "logging.hpp"
+#include "snapshot.hpp"
+#include "settings.hpp"
+#include "boot.hpp"
+#include "sniffer.hpp"
 
 #include "webinterface/bundle.hpp"
 
 static WebServer server;
 
-static void handleIndex()
+static void handleAsset(const web_asset_t *asset)
 {
+	if(asset->immutable)
+		server.sendHeader("Cache-Control", "public, max-age=31536000, immutable");
+	else
+		server.sendHeader("Cache-Control", "no-cache");
+	server.sendHeader("ETag", asset->etag);
+
+	if(server.header("If-None-Match") == asset->etag)
+	{
+		server.send(304);
+		return;
+	}
+
 	server.sendHeader("Content-Encoding", "gzip");
-	server.send_P(200, PSTR("text/html"), (PGM_P)webpageData, sizeof(webpageData) / sizeof(*webpageData));
+	server.send_P(200, asset->mimeType, (PGM_P)asset->data, asset->length);
 }
 
-static void handleData()
+// answers conditional requests for the current snapshot, returns true when done
+static bool handleSnapshotETag()
 {
-	String data = String("{") +
-		"\"throttle\": " + scooterStatus.throttle +
-		", \"brake\": " + scooterStatus.brake +
-		", \"ecoMode\": " + scooterStatus.ecoMode +
-		", \"shuttingDown\": " + scooterStatus.shuttingDown +
-		", \"lights\": " + scooterStatus.lights +
-		", \"buttonPress\": " + scooterStatus.buttonPress +
-		", \"errorCode\": " + scooterStatus.errorCode +
-		", \"soc\": " + scooterStatus.soc +
-		", \"speed\": " + scooterStatus.speed +
-		", \"totalOperationTime\": " + scooterStatus.totalOperationTime +
-		", \"timeSinceBoot\": " + scooterStatus.timeSinceBoot +
-		", \"voltage\": " + scooterStatus.voltage +
-		", \"current\": " + scooterStatus.current +
-		", \"mainboardVersion\": " + scooterStatus.mainboardVersion +
-		", \"odometer\": " + scooterStatus.odometer +
-		", \"isLocked\": " + isLocked +
-		", \"updateStatus\": \"" + firmwareUpdateStatus + "\"" +
-	"}";
-
-	server.send(200, "application/json", data);
+	char etag[24];
+	snapshotETag(etag, sizeof(etag));
+
+	if(server.header("If-None-Match") == etag)
+	{
+		server.send(304);
+		return true;
+	}
+
+	server.sendHeader("ETag", etag);
+	server.sendHeader("Cache-Control", "no-cache");
+	return false;
 }
 
-static void handleConfig()
+static void handleData()
 {
-	String data = String("{") +
-		"\"" PREFERENCE_MAX_SPEED "\": " + configuredSpeed +
-		", \"" PREFERENCE_SHOW_INTRO "\": " + preferences.getUChar(PREFERENCE_SHOW_INTRO, 1) +
-		", \"" PREFERENCE_REENABLE_LIGHT "\": " + reenableLightsAfterError +
-		", \"" PREFERENCE_LOCK_ON_BOOT "\": " + preferences.getUChar(PREFERENCE_LOCK_ON_BOOT, 0) +
-		", \"" PREFERENCE_LOCK_PIN "\": \"" + scooterPin + "\"" +
-		", \"" PREFERENCE_BLE_ENABLE "\": " + preferences.getUChar(PREFERENCE_BLE_ENABLE, 0) +
-		", \"" PREFERENCE_BLE_CONTROL_ENABLE "\": " + preferences.getUChar(PREFERENCE_BLE_CONTROL_ENABLE, 0) +
-		", \"" PREFERENCE_AP_ENABLE "\": " + preferences.getUChar(PREFERENCE_AP_ENABLE, 1) +
-		", \"" PREFERENCE_AP_SSID "\": \"" + wifiApSsid + "\"" +
-		", \"" PREFERENCE_AP_PASSWORD "\": \"" + wifiApPassword + "\"" +
-		", \"" PREFERENCE_STA_ENABLE "\": " + preferences.getUChar(PREFERENCE_STA_ENABLE, 0) +
-		", \"" PREFERENCE_STA_SSID "\": \"" + wifiStaSsid + "\"" +
-		", \"" PREFERENCE_STA_PASSWORD "\": \"" + wifiStaPassword + "\"" +
-		", \"" PREFERENCE_UPDATE_URL "\": \"" + firmwareUpdateUrl + "\"" +
-	"}";
+	if(handleSnapshotETag())
+		return;
+
+	size_t len;
+	const char *json = snapshotJson(len);
 
-	server.send(200, "application/json", data);
+	if(len == 0)
+		server.send(500, "text/plain", "status too large");
+	else
+		server.send_P(200, PSTR("application/json"), json, len);
 }
 
-static bool updateBoolPreference(const char *name, bool oldVal)
+static void handleDataBinary()
 {
-	if(!server.hasArg(name))
-		return oldVal;
+	if(handleSnapshotETag())
+		return;
 
-	bool val = server.arg(name) == "true";
-	if(val != oldVal)
-		preferences.putUChar(name, val);
+	size_t len;
+	const uint8_t *data = snapshotBinary(len);
 
-	return val;
+	server.send_P(200, PSTR("application/octet-stream"), (PGM_P)data, len);
 }
-static void updateStringPreference(const char *name, String *valPtr)
+
+static void handleConfig()
 {
-	if(!server.hasArg(name))
-		return;
+	char buff[1024];
+	json_writer_t writer;
+	jsonBegin(writer, buff, sizeof(buff));
 
-	String val = server.arg(name);
-	if(val != *valPtr)
+	xSemaphoreTake(stateMutex, portMAX_DELAY);
+	for(uint8_t i = 0; i < SETTINGS_COUNT; i++)
 	{
-		preferences.putString(name, val);
-		*valPtr = val;
+		const setting_t& setting = settingsTable[i];
+		jsonKey(writer, setting.key);
+
+		if(setting.type == SETTING_STRING)
+			jsonString(writer, settingsGetString((setting_id_t)i));
+		else
+			jsonUInt(writer, settingsGetUInt((setting_id_t)i));
 	}
+	xSemaphoreGive(stateMutex);
+
+	size_t len = jsonEnd(writer);
+	if(len == 0)
+		server.send(500, "text/plain", "config too large");
+	else
+		server.send_P(200, PSTR("application/json"), buff, len);
 }
+
 static void handleUpdateConfig()
 {
-	String maxSpeedStr = server.arg(PREFERENCE_MAX_SPEED);
-	uint32_t maxSpeed = atoi(maxSpeedStr.c_str());
-	if(maxSpeed >= 12 && maxSpeed <= 40 && maxSpeed != configuredSpeed)
+	// validate all values first, a request is either applied completely or not at all
+	for(uint8_t i = 0; i < SETTINGS_COUNT; i++)
 	{
-		setMaxSpeed(maxSpeed);
-		setMaxSpeed(maxSpeed);
-		setMaxSpeed(maxSpeed);
+		const setting_t& setting = settingsTable[i];
+		if(!server.hasArg(setting.key))
+			continue;
 
-		configuredSpeed = maxSpeed;
-		preferences.putUChar(PREFERENCE_MAX_SPEED, maxSpeed);
+		String val = server.arg(setting.key);
+		bool valid = true;
+		if(setting.type == SETTING_STRING)
+			valid = settingsValid((setting_id_t)i, val.c_str());
+		else if(setting.type == SETTING_UINT8)
+			valid = val.length() > 0 && settingsValid((setting_id_t)i, atoi(val.c_str()));
+
+		if(!valid)
+		{
+			server.send(400, "text/plain", String("invalid ") + setting.key);
+			return;
+		}
 	}
-	else if(maxSpeed != configuredSpeed)
+
+	uint8_t oldMaxSpeed = settings.maxSpeed;
+
+	xSemaphoreTake(stateMutex, portMAX_DELAY);
+	for(uint8_t i = 0; i < SETTINGS_COUNT; i++)
+	{
+		const setting_t& setting = settingsTable[i];
+		if(!server.hasArg(setting.key))
+			continue;
+
+		String val = server.arg(setting.key);
+		if(setting.type == SETTING_STRING)
+			settingsSetString((setting_id_t)i, val.c_str());
+		else if(setting.type == SETTING_BOOL)
+			settingsSetUInt((setting_id_t)i, val == "true");
+		else
+			settingsSetUInt((setting_id_t)i, atoi(val.c_str()));
+	}
+	xSemaphoreGive(stateMutex);
+
+	if(settings.maxSpeed != oldMaxSpeed)
+		queueBusCommand(BUS_COMMAND_MAX_SPEED, settings.maxSpeed);
+
+	settingsCommit();
+	server.send(200, "text/plain", "ok");
+}
+
+template<typename T, uint16_t N>
+static void sendHistory(history_ring_t<T, N>& ring)
+{
+	// the main loop pushes into the ring while we send, so it is copied under
+	// stateMutex first, oldest entry first, as raw little endian entries.
+	// X-History-Last is the slot of the newest one, seconds and minutes since
+	// boot or hours of operation, every entry before it is one slot earlier.
+	T *entries = (T *)malloc(N * sizeof(T));
+	if(entries == NULL)
 	{
-		server.send(400, "text/plain", "invalid speed");
+		server.send(503, "text/plain", "out of memory");
 		return;
 	}
 
-	updateBoolPreference(PREFERENCE_SHOW_INTRO, preferences.getUChar(PREFERENCE_SHOW_INTRO, 1));
-	updateBoolPreference(PREFERENCE_LOCK_ON_BOOT, preferences.getUChar(PREFERENCE_LOCK_ON_BOOT, 0));
-	updateBoolPreference(PREFERENCE_BLE_ENABLE, preferences.getUChar(PREFERENCE_BLE_ENABLE, 0));
-	bluetoothControlEnabled = updateBoolPreference(PREFERENCE_BLE_CONTROL_ENABLE, bluetoothControlEnabled);
-	updateBoolPreference(PREFERENCE_AP_ENABLE, preferences.getUChar(PREFERENCE_AP_ENABLE, 1));
-	updateBoolPreference(PREFERENCE_STA_ENABLE, preferences.getUChar(PREFERENCE_STA_ENABLE, 0));
-	reenableLightsAfterError = updateBoolPreference(PREFERENCE_REENABLE_LIGHT, reenableLightsAfterError);
+	xSemaphoreTake(stateMutex, portMAX_DELAY);
+	uint16_t count = ring.count;
+	uint32_t lastTime = ring.lastTime;
+	uint16_t start = count < N ? 0 : ring.pos;
+	uint16_t firstPart = count < N ? count : N - start;
+	memcpy(entries, &ring.entries[start], firstPart * sizeof(T));
+	memcpy(entries + firstPart, &ring.entries[0], (count - firstPart) * sizeof(T));
+	xSemaphoreGive(stateMutex);
 
-	updateStringPreference(PREFERENCE_LOCK_PIN, &scooterPin);
-	updateStringPreference(PREFERENCE_AP_SSID, &wifiApSsid);
-	updateStringPreference(PREFERENCE_AP_PASSWORD, &wifiApPassword);
-	updateStringPreference(PREFERENCE_STA_SSID, &wifiStaSsid);
-	updateStringPreference(PREFERENCE_STA_PASSWORD, &wifiStaPassword);
-	updateStringPreference(PREFERENCE_UPDATE_URL, &firmwareUpdateUrl);
+	server.sendHeader("X-History-Count", String(count));
+	server.sendHeader("X-History-Last", String(lastTime));
+	server.setContentLength(count * sizeof(T));
+	server.send(200, "application/octet-stream", "");
+	server.sendContent((const char *)entries, count * sizeof(T));
+	free(entries);
+}
+static void handleHistory()
+{
+	String tier = server.pathArg(0);
 
-	server.send(200, "text/plain", "ok");
+	if(tier == "seconds")
+		sendHistory(historySeconds);
+	else if(tier == "minutes")
+		sendHistory(historyMinutes);
+	else if(tier == "hours")
+		sendHistory(historyHours);
+	else
+		server.send(404, "text/plain", "unknown history tier");
 }
 
 static void handleFirwareUpdate()
 {
-	server.send(200, "text/plain", "starting update process...");
+	if(startFirmwareUpdate())
+		server.send(200, "text/plain", "starting update process...");
+	else
+		server.send(409, "text/plain", "no internet or update already running");
+}
+
+static void handleCancelFirmwareUpdate()
+{
+	cancelFirmwareUpdate();
+	server.send(200, "text/plain", "ok");
+}
+
+static void handleBluetoothStats()
+{
+	ble_request_stats_t stats = bleRequestStats;
+
+	char buff[192];
+	json_writer_t writer;
+	jsonBegin(writer, buff, sizeof(buff));
+	jsonKey(writer, "received");
+	jsonUInt(writer, stats.received);
+	jsonKey(writer, "dropped");
+	jsonUInt(writer, stats.dropped);
+	jsonKey(writer, "depth");
+	jsonUInt(writer, stats.depth);
+	jsonKey(writer, "maxDepth");
+	jsonUInt(writer, stats.maxDepth);
+	jsonKey(writer, "lastLatency");
+	jsonUInt(writer, stats.lastLatency);
+	jsonKey(writer, "maxLatency");
+	jsonUInt(writer, stats.maxLatency);
+
+	size_t len = jsonEnd(writer);
+	server.send_P(200, PSTR("application/json"), buff, len);
+}
+
+static void handleBootStats()
+{
+	char buff[256];
+	json_writer_t writer;
+	jsonBegin(writer, buff, sizeof(buff));
+	for(uint8_t i = 0; i < BOOT_PHASE_COUNT; i++)
+	{
+		jsonKey(writer, bootPhaseNames[i]);
+		jsonUInt(writer, bootTimestamps[i]);
+	}
 
-	checkForFirmwareUpdates();
+	size_t len = jsonEnd(writer);
+	server.send_P(200, PSTR("application/json"), buff, len);
+}
+
+static void handleUploadChunk()
+{
+	HTTPUpload& upload = server.upload();
+	if(upload.status == UPLOAD_FILE_START)
+		firmwareUploadBegin();
+	else if(upload.status == UPLOAD_FILE_WRITE)
+		firmwareUploadWrite(upload.buf, upload.currentSize);
+	else if(upload.status == UPLOAD_FILE_ABORTED)
+		firmwareUploadAbort();
+}
+static void handleUpload()
+{
+	char digest[65];
+	String expectedHash = server.arg("sha256");
+	const char *error = firmwareUploadEnd(expectedHash.c_str(), digest);
+
+	// the minimum free heap lets host tools check the RAM used during the upload
+	char buff[160];
+	snprintf(buff, sizeof(buff), "%s\nsha256: %s\nmin free heap: %lu\n",
+		error == NULL ? "ok" : error, digest, (unsigned long)ESP.getMinFreeHeap());
+	server.send(error == NULL ? 200 : 400, "text/plain", buff);
 }
 
 static void handleAction()
@@ -135,44 +276,205 @@ static void handleAction()
 	String action = server.pathArg(0);
 	bool enabled = server.pathArg(1) == "true";
 
+	bool queued = true;
 	if(action == "setEcoMode")
+		queued = queueBusCommand(BUS_COMMAND_ECO_MODE, enabled);
+	else if(action == "setLock")
+		queued = queueBusCommand(BUS_COMMAND_LOCK, enabled);
+	else if(action == "setLight")
+		queued = queueBusCommand(BUS_COMMAND_LIGHT, enabled);
+
+	if(queued)
+		server.send(200, "text/plain", "ok");
+	else
+		server.send(503, "text/plain", "busy");
+}
+
+//
+// status stream
+//
+// Clients connecting to STREAM_PORT receive server-sent events containing
+// only the fields which changed since the last event sent to that client.
+// Every client is throttled individually, updates arriving in between two
+// events are coalesced as we always diff against what the client has seen,
+// see snapshotEvent.
+//
+
+typedef struct
+{
+	WiFiClient client;
+	bool streaming; // request received, client is waiting for events
+	uint32_t generation; // last snapshot generation sent, 0 if none
+	uint8_t headerMatch; // number of matched bytes of the "\r\n\r\n" request end
+	uint16_t interval;
+	uint32_t lastSend;
+} stream_client_t;
+
+static WiFiServer streamServer(STREAM_PORT);
+static stream_client_t streamClients[STREAM_MAX_CLIENTS];
+
+static void streamAccept()
+{
+	WiFiClient client = streamServer.available();
+	if(!client)
+		return;
+
+	for(int i = 0; i < STREAM_MAX_CLIENTS; i++)
 	{
-		setEcoMode(enabled);
-		setEcoMode(enabled);
-		setEcoMode(enabled);
+		stream_client_t *curr = &streamClients[i];
+		if(curr->client.connected())
+			continue;
+
+		curr->client = client;
+		curr->streaming = false;
+		curr->generation = 0;
+		curr->headerMatch = 0;
+		curr->interval = STREAM_MIN_INTERVAL;
+		return;
 	}
-	else if(action == "setLock")
+
+	client.print("HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\n\r\n");
+	client.stop();
+}
+
+static bool streamReadRequest(stream_client_t *curr)
+{
+	// we don't care about the request itself, just wait until it is complete
+	static const char requestEnd[] = "\r\n\r\n";
+	while(curr->client.available())
 	{
-		isLocked = enabled;
-		setLock(enabled);
-		delay(50);
-		setLock(enabled);
-		delay(50);
-		setLock(enabled);
+		char c = curr->client.read();
+		if(c == requestEnd[curr->headerMatch])
+			curr->headerMatch++;
+		else
+			curr->headerMatch = c == '\r' ? 1 : 0;
+
+		if(curr->headerMatch == 4)
+			return true;
 	}
-	else if(action == "setLight")
+
+	return false;
+}
+
+static void streamSend(stream_client_t *curr, uint32_t now)
+{
+	const char *data;
+	size_t len;
+	uint32_t generation = curr->generation;
+	if(curr->generation != statusGeneration)
+	{
+		data = snapshotEvent(curr->generation, len, generation);
+		if(len == 0)
+		{
+			// should never happen, the event buffer is large enough for all fields
+			curr->client.stop();
+			return;
+		}
+	}
+	else if(now - curr->lastSend >= STREAM_KEEPALIVE_INTERVAL)
 	{
-		internalSetLight(enabled);
+		// nothing changed, send a comment once in a while to detect dead clients
+		data = ":\n\n";
+		len = 3;
+	}
+	else
+	{
+		return;
 	}
 
-	server.send(200, "text/plain", "ok");
+	uint32_t start = millis();
+	if(curr->client.write((const uint8_t *)data, len) != len)
+	{
+		// a partially written event would corrupt the stream
+		curr->client.stop();
+		return;
+	}
+
+	// back off for clients whose socket buffer is filling up
+	uint32_t duration = millis() - start;
+	if(duration > STREAM_SLOW_WRITE && curr->interval < STREAM_MAX_INTERVAL)
+	{
+		curr->interval *= 2;
+		if(curr->interval > STREAM_MAX_INTERVAL)
+			curr->interval = STREAM_MAX_INTERVAL;
+	}
+	else if(duration <= STREAM_SLOW_WRITE && curr->interval > STREAM_MIN_INTERVAL)
+		curr->interval -= STREAM_MIN_INTERVAL;
+
+	curr->generation = generation;
+	curr->lastSend = now;
+}
+
+static void streamLoop()
+{
+	streamAccept();
+
+	uint32_t now = millis();
+	for(int i = 0; i < STREAM_MAX_CLIENTS; i++)
+	{
+		stream_client_t *curr = &streamClients[i];
+		if(!curr->client.connected())
+			continue;
+
+		if(!curr->streaming)
+		{
+			if(!streamReadRequest(curr))
+				continue;
+
+			curr->client.print("HTTP/1.1 200 OK\r\n"
+				"Content-Type: text/event-stream\r\n"
+				"Cache-Control: no-cache\r\n"
+				"Access-Control-Allow-Origin: *\r\n\r\n");
+			curr->streaming = true;
+		}
+
+		if(now - curr->lastSend >= curr->interval)
+			streamSend(curr, now);
+	}
+}
+
+static void webServerTask(void *arg)
+{
+	for(;;)
+	{
+		server.handleClient();
+		streamLoop();
+		vTaskDelay(1);
+	}
 }
 
 void webServerSetup()
 {
-	server.on("/", handleIndex);
+	static const char *collectedHeaders[] = {"If-None-Match"};
+	server.collectHeaders(collectedHeaders, sizeof(collectedHeaders) / sizeof(*collectedHeaders));
+
+	for(const web_asset_t& asset : webAssets)
+	{
+		const web_asset_t *ptr = &asset;
+		server.on(asset.path, HTTP_GET, [ptr]() { handleAsset(ptr); });
+	}
+
 	server.on("/data", handleData);
+	server.on("/data.bin", handleDataBinary);
 	server.on("/config", handleConfig);
+	server.on("/history/{}", handleHistory);
 	server.on("/updateConfig", handleUpdateConfig);
 	server.on("/updateFirmware", handleFirwareUpdate);
+	server.on("/cancelFirmwareUpdate", handleCancelFirmwareUpdate);
+	server.on("/upload", HTTP_POST, handleUpload, handleUploadChunk);
 	server.on("/action/{}/{}", handleAction);
+	server.on("/stats/bluetooth", handleBluetoothStats);
+	server.on("/stats/boot", handleBootStats);
 
 	if(wifiApEnabled || wifiStaEnabled)
+	{
 		server.begin();
-}
+		streamServer.begin();
+		snifferBegin();
 
-void webServerLoop()
-{
-	if(wifiApEnabled || wifiStaEnabled)
-		server.handleClient();
+		// requests are handled in their own task, handlers never write to
+		// ScooterSerial but queue their commands for the main loop
+		xTaskCreatePinnedToCore(webServerTask, "webserver", WEBSERVER_TASK_STACK,
+			NULL, WEBSERVER_TASK_PRIORITY, NULL, WEBSERVER_TASK_CORE);
+	}
 }
\ No newline at end of file
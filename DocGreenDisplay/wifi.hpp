@@ -6,35 +6,24 @@
 
 bool wifiApEnabled;
 bool wifiStaEnabled;
-String wifiApSsid;
-String wifiApPassword;
-String wifiStaSsid;
-String wifiStaPassword;
 
 void wifiSetup()
 {
-	wifiApEnabled = preferences.getUChar(PREFERENCE_AP_ENABLE, 1);
-	wifiStaEnabled = preferences.getUChar(PREFERENCE_STA_ENABLE, 0);
-
-	wifiApSsid = preferences.getString(PREFERENCE_AP_SSID, "");
-	wifiApPassword = preferences.getString(PREFERENCE_AP_PASSWORD, "");
-	wifiStaSsid = preferences.getString(PREFERENCE_STA_SSID, "");
-	wifiStaPassword = preferences.getString(PREFERENCE_STA_PASSWORD, "");
+	wifiApEnabled = settings.apEnable;
+	wifiStaEnabled = settings.staEnable;
 
 	WiFi.persistent(false);
 
 	char buff[32];
-	if(wifiApSsid == "")
+	if(settings.apSsid[0] == 0)
 	{
 		// no wifi ssid defined, we generate a default one using our MAC
 
 		uint32_t mac = ESP.getEfuseMac() >> 24;
 		sprintf(buff, "Scooter %06X", mac);
-		wifiApSsid = String(buff);
-
-		preferences.putString(PREFERENCE_AP_SSID, wifiApSsid);
+		settingsSetString(SETTING_AP_SSID, buff);
 	}
-	if(wifiApPassword == "")
+	if(settings.apPassword[0] == 0)
 	{
 		// no wifi password, we enable a dummy station in order to have access
 		//  to the RF based esp_random(), which we then use to generate a
@@ -50,12 +39,10 @@ void wifiSetup()
 
 		sprintf(buff, "%08X%08X", rnd1, rnd2);
 
-		wifiApPassword = String(buff);
-
-		preferences.putString(PREFERENCE_AP_PASSWORD, wifiApPassword);
+		settingsSetString(SETTING_AP_PASSWORD, buff);
 	}
 
-	if(wifiStaSsid == "")
+	if(settings.staSsid[0] == 0)
 		wifiStaEnabled = false;
 
 	if(wifiApEnabled && wifiStaEnabled)
@@ -70,16 +57,16 @@ void wifiSetup()
 	if(wifiStaEnabled)
 	{
 		const char *password;
-		if(wifiStaPassword == "")
+		if(settings.staPassword[0] == 0)
 			password = NULL;
 		else
-			password = wifiStaPassword.c_str();
+			password = settings.staPassword;
 
 		WiFi.setHostname("ScooterDashboard");
-		WiFi.begin(wifiStaSsid.c_str(), password);
+		WiFi.begin(settings.staSsid, password);
 	}
 	if(wifiApEnabled)
 	{
-		WiFi.softAP(wifiApSsid.c_str(), wifiApPassword.c_str());
+		WiFi.softAP(settings.apSsid, settings.apPassword);
 	}
 }
@@ -1,64 +1,199 @@
 #include <Arduino.h>
 
-void logByteInHex(uint8_t val)
+// set to 0 for the old hex dump of frames with a valid checksum
+#ifndef CAPTURE_BINARY
+#define CAPTURE_BINARY 1
+#endif
+
+// the binary capture is larger than the sniffed traffic, so the USB side has
+// to be faster than the 115200 baud of the bus
+#if CAPTURE_BINARY
+#define HOST_BAUD 1000000
+#else
+#define HOST_BAUD 115200
+#endif
+#define BUS_BAUD 115200
+
+// bytes of a frame are sent back to back, a longer pause inside a frame means
+// the rest was lost, e.g. in a collision
+#define FRAME_GAP_US 500
+
+// Binary capture format, one record per frame, numbers are little endian:
+//   'D' 'G' flags (u8) timestamp (u32, micros of the 0x55) length (u16) data
+// data are the bytes after 55 AA including the checksum, length is their count
+#define RECORD_FLAG_BAD_CHECKSUM 0x01
+#define RECORD_FLAG_TRUNCATED 0x02 // gap inside the frame, data is incomplete
+#define RECORD_FLAG_OVERFLOW 0x04 // bytes were lost before this frame
+
+// received bytes of the bus with the time they arrived, filled by the USART2
+// interrupt, Serial2 is not used so its interrupt handler isn't linked
+#define RX_RING_SIZE 1024
+
+typedef struct
 {
-	if(val < 16)
-		Serial.print('0');
+	uint32_t time;
+	uint8_t val;
+} rx_entry_t;
 
-	Serial.print(val, 16);
-	Serial.print(' ');
-}
+static volatile rx_entry_t rxRing[RX_RING_SIZE];
+static volatile uint16_t rxHead = 0;
+static volatile uint16_t rxTail = 0;
+static volatile bool rxOverflow = false;
 
-uint8_t readBlocking()
+ISR(USART2_RX_vect)
 {
-	while(!Serial2.available())
-		delay(1);
+	bool overrun = UCSR2A & _BV(DOR2);
+	uint8_t val = UDR2;
+	uint16_t next = (rxHead + 1) % RX_RING_SIZE;
+	if(overrun || next == rxTail)
+		rxOverflow = true;
+	if(next == rxTail)
+		return;
 
-	return Serial2.read();
+	rxRing[rxHead].time = micros();
+	rxRing[rxHead].val = val;
+	rxHead = next;
 }
 
-void setup()
+static void busBegin()
 {
-	Serial.begin(115200);
-	Serial2.begin(115200);
-
-	Serial.println("Starting Logging data...");
+	// same settings as HardwareSerial, which uses U2X for 115200 at 16MHz
+	UBRR2 = (F_CPU / 8 / BUS_BAUD) - 1;
+	UCSR2A = _BV(U2X2);
+	UCSR2C = _BV(UCSZ21) | _BV(UCSZ20);
+	UCSR2B = _BV(RXEN2) | _BV(RXCIE2);
 }
 
-uint8_t buff[256];
-void loop()
+static bool busRead(rx_entry_t& entry)
 {
+	uint8_t oldSREG = SREG;
+	cli();
 
-	while(readBlocking() != 0x55);
-	if(readBlocking() != 0xAA)
-		return;
+	bool available = rxHead != rxTail;
+	if(available)
+	{
+		entry.time = rxRing[rxTail].time;
+		entry.val = rxRing[rxTail].val;
+		rxTail = (rxTail + 1) % RX_RING_SIZE;
+	}
 
-	uint8_t len = readBlocking();
-	buff[0] = len;
-	if(len > 254)
-		return;
+	SREG = oldSREG;
+	return available;
+}
+
+void logByteInHex(uint8_t val)
+{
+	if(val < 16)
+		Serial.print('0');
 
-	uint8_t addr = readBlocking();
-	buff[1] = addr;
+	Serial.print(val, 16);
+	Serial.print(' ');
+}
 
-	uint16_t sum = len + addr;
-	for(int i = 0; i < len; i++)
-	{
-		uint8_t curr = readBlocking();
-		buff[i + 2] = curr;
-		sum += curr;
-	}
+void setup()
+{
+	Serial.begin(HOST_BAUD);
+	busBegin();
 
+#if !CAPTURE_BINARY
+	Serial.println("Starting Logging data...");
+#endif
+}
+
+uint8_t buff[256 + 4];
+static uint16_t pos = 0; // bytes of the current frame in buff, after 55 AA
+static uint8_t headerPos = 0; // 55 AA bytes seen
+static uint32_t frameStart;
+static uint32_t lastByte;
+static uint8_t frameFlags = 0;
 
-	uint16_t checksum = (uint16_t)readBlocking() | ((uint16_t)readBlocking() << 8);
-	if(checksum != (sum ^ 0xFFFF))
+static void emitFrame(uint8_t flags)
+{
+	uint16_t sum = 0;
+	for(uint16_t i = 0; i + 2 < pos; i++)
+		sum += buff[i];
+
+	uint16_t checksum = 0;
+	if(pos >= 2)
+		checksum = (uint16_t)buff[pos - 2] | ((uint16_t)buff[pos - 1] << 8);
+	if((flags & RECORD_FLAG_TRUNCATED) || checksum != (sum ^ 0xFFFF))
+		flags |= RECORD_FLAG_BAD_CHECKSUM;
+
+#if CAPTURE_BINARY
+	uint8_t header[] = {
+		'D', 'G', flags,
+		(uint8_t)frameStart, (uint8_t)(frameStart >> 8),
+		(uint8_t)(frameStart >> 16), (uint8_t)(frameStart >> 24),
+		(uint8_t)pos, (uint8_t)(pos >> 8),
+	};
+	Serial.write(header, sizeof(header));
+	Serial.write(buff, pos);
+#else
+	if(flags != 0)
 		return;
 
-	for(int i = 0; i < len + 2; i++)
+	for(uint16_t i = 0; i + 2 < pos; i++)
 		logByteInHex(buff[i]);
 
 	Serial.print("check ");
 	Serial.print(checksum, 16);
 
 	Serial.println();
+#endif
+}
+
+void loop()
+{
+	rx_entry_t entry;
+	while(busRead(entry))
+	{
+		if(rxOverflow)
+		{
+			rxOverflow = false;
+			frameFlags |= RECORD_FLAG_OVERFLOW;
+		}
+
+		// keep what we got of a frame which stopped in the middle
+		if(headerPos > 0 && entry.time - lastByte > FRAME_GAP_US)
+		{
+			if(pos > 0)
+			{
+				emitFrame(frameFlags | RECORD_FLAG_TRUNCATED);
+				frameFlags = 0;
+			}
+			pos = 0;
+			headerPos = 0;
+		}
+		lastByte = entry.time;
+
+		if(headerPos == 0)
+		{
+			if(entry.val == 0x55)
+			{
+				headerPos = 1;
+				frameStart = entry.time;
+			}
+			continue;
+		}
+		else if(headerPos == 1)
+		{
+			if(entry.val == 0xAA)
+				headerPos = 2;
+			else if(entry.val != 0x55)
+				headerPos = 0;
+			else
+				frameStart = entry.time;
+			continue;
+		}
+
+		buff[pos++] = entry.val;
+		// length, address, payload and checksum
+		if(pos >= 4 && pos == (uint16_t)buff[0] + 4)
+		{
+			emitFrame(frameFlags);
+			frameFlags = 0;
+			pos = 0;
+			headerPos = 0;
+		}
+	}
 }
\ No newline at end of file
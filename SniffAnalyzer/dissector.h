@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+
+// autogenerated by generate-protocol.py from docgreen-protocol.json, do not edit
+
+typedef enum : uint8_t
+{
+	DISSECTOR_UINT,
+	DISSECTOR_INT,
+	DISSECTOR_FLAG,
+} dissector_type_t;
+
+typedef struct
+{
+	const char *name;
+	uint8_t offset;
+	uint8_t width;
+	dissector_type_t type;
+	bool bigEndian;
+	uint8_t on; // flags only
+	double scale;
+	const char *unit;
+} dissector_field_t;
+
+typedef struct
+{
+	const char *name;
+	uint8_t address;
+	uint8_t length;
+	int16_t command; // -1 for any
+	int16_t arg; // -1 for any
+	const dissector_field_t *fields;
+	uint8_t fieldCount;
+} dissector_packet_t;
+
+static const dissector_field_t dissectorFields0[] = {
+	{"ecoMode", 4, 1, DISSECTOR_FLAG, false, 0x02, 1.0, ""},
+	{"shuttingDown", 5, 1, DISSECTOR_FLAG, false, 0x08, 1.0, ""},
+	{"lights", 6, 1, DISSECTOR_FLAG, false, 0x01, 1.0, ""},
+	{"speed", 8, 2, DISSECTOR_UINT, false, 0x00, 0.001, "km/h"},
+	{"buttonPress", 10, 1, DISSECTOR_FLAG, false, 0x01, 1.0, ""},
+	{"errorCode", 11, 1, DISSECTOR_UINT, false, 0x00, 1.0, ""},
+	{"soc", 12, 1, DISSECTOR_UINT, false, 0x00, 1.0, "%"},
+};
+static const dissector_field_t dissectorFields1[] = {
+	{"totalOperationTime", 4, 4, DISSECTOR_UINT, false, 0x00, 1.0, "s"},
+	{"timeSinceBoot", 20, 4, DISSECTOR_UINT, false, 0x00, 1.0, "s"},
+	{"voltage", 46, 2, DISSECTOR_UINT, false, 0x00, 0.01, "V"},
+	{"current", 48, 2, DISSECTOR_INT, false, 0x00, 0.01, "A"},
+};
+static const dissector_field_t dissectorFields2[] = {
+	{"mainboardVersion", 10, 4, DISSECTOR_UINT, false, 0x00, 1.0, ""},
+	{"odometer", 34, 4, DISSECTOR_UINT, false, 0x00, 0.001, "km"},
+};
+static const dissector_field_t dissectorFields3[] = {
+	{"throttle", 5, 1, DISSECTOR_UINT, false, 0x00, 1.0, ""},
+	{"brake", 6, 1, DISSECTOR_UINT, false, 0x00, 1.0, ""},
+};
+
+static const dissector_packet_t dissectorPackets[] = {
+	{"MOTOR_INFO", 0x28, 0x0b, -1, -1, dissectorFields0, 7},
+	{"DETAILED_INFO_1", 0x11, 0x34, -1, 0x00, dissectorFields1, 4},
+	{"DETAILED_INFO_2", 0x11, 0x34, -1, 0x28, dissectorFields2, 2},
+	{"INPUT", 0x25, 0x07, 0x60, -1, dissectorFields3, 2},
+};
@@ -0,0 +1,529 @@
+// Statistics over bus captures to help decoding unknown bytes of the protocol.
+//
+// build: g++ -O2 -std=c++17 -o sniff-analyzer sniff-analyzer.cpp
+// usage: ./sniff-analyzer [-d] [-e events.txt] [-w window] [-n changes] capture...
+//
+// Captures are either the text dumps of MegaSniffer (one frame per line,
+// "07 25 60 05 04 2C 2C 00 00 check FF12" or "55 AA 0B 28 ... 62 EB FE",
+// where frames with a wrong checksum are counted as bad) or its binary
+// capture format.
+// Frames are grouped by address, command and length and every byte position
+// is stored as its own column, so the statistics run over plain byte arrays.
+//
+// For every group and byte the tool prints the number of distinct values, the
+// entropy in bits and the number of changes with the first change points.
+// An events file labels positions in captures, one event per line:
+//   <capture path> <frame index> <label>
+// The frame index counts all frames of the capture starting at 0. For every
+// label the bytes changing within -w frames around its events are listed,
+// compared to how often they change anywhere else.
+//
+// Bytes of known fields are annotated with their name, -d additionally prints
+// the decoded fields of every frame. Both use dissector.h, which is generated
+// from docgreen-protocol.json by generate-protocol.py.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dissector.h"
+// calculateChecksum
+#include "../DocGreenDisplay/protocol-core.h"
+
+#define RECORD_FLAG_BAD_CHECKSUM 0x01
+#define RECORD_FLAG_TRUNCATED 0x02
+#define RECORD_HEADER_SIZE 9
+
+typedef struct
+{
+	uint8_t len;
+	uint8_t addr;
+	uint8_t cmd;
+	std::vector<uint16_t> capture;
+	std::vector<uint32_t> frame; // index of the frame in its capture
+	std::vector<uint32_t> time; // micros, 0 for text captures
+	std::vector<std::vector<uint8_t>> columns; // frame bytes without the checksum
+} frame_group_t;
+
+typedef struct
+{
+	std::string path;
+	uint32_t frames;
+	uint32_t badFrames;
+} capture_t;
+
+typedef struct
+{
+	uint16_t capture;
+	uint32_t frame;
+	std::string label;
+} event_t;
+
+static std::vector<capture_t> captures;
+static std::map<uint32_t, frame_group_t> groups;
+static bool printDecoded = false;
+
+// data starts with the length byte, len doesn't include the checksum
+static const dissector_packet_t *dissectorFind(const uint8_t *data, uint16_t len)
+{
+	for(const dissector_packet_t& packet : dissectorPackets)
+	{
+		if(len >= 4 && data[0] == packet.length && data[1] == packet.address
+			&& (packet.command < 0 || data[2] == packet.command)
+			&& (packet.arg < 0 || data[3] == packet.arg))
+			return &packet;
+	}
+	return NULL;
+}
+
+static double dissectorValue(const dissector_field_t& field, const uint8_t *data)
+{
+	if(field.type == DISSECTOR_FLAG)
+		return data[field.offset] == field.on;
+
+	uint32_t raw = 0;
+	for(uint8_t k = 0; k < field.width; k++)
+	{
+		uint8_t val = data[field.offset + (field.bigEndian ? field.width - 1 - k : k)];
+		raw |= (uint32_t)val << (8 * k);
+	}
+
+	if(field.type == DISSECTOR_INT && field.width < 4 && (raw & (1UL << (8 * field.width - 1))))
+		return ((double)raw - (double)(1UL << (8 * field.width))) * field.scale;
+	else if(field.type == DISSECTOR_INT)
+		return (double)(int32_t)raw * field.scale;
+	return raw * field.scale;
+}
+
+static void printFrame(uint16_t capture, uint32_t time, const uint8_t *data, uint16_t len)
+{
+	const dissector_packet_t *packet = dissectorFind(data, len);
+	if(packet == NULL)
+		return;
+
+	printf("%s#%u %u %s", captures[capture].path.c_str(), captures[capture].frames, time, packet->name);
+	for(uint8_t i = 0; i < packet->fieldCount; i++)
+	{
+		const dissector_field_t& field = packet->fields[i];
+		if(field.offset + field.width > len) // short dumps
+			continue;
+		printf(" %s=%g%s", field.name, dissectorValue(field, data), field.unit);
+	}
+	printf("\n");
+}
+
+static void addFrame(uint16_t capture, uint32_t time, const uint8_t *data, uint16_t len)
+{
+	uint32_t key = (uint32_t)len << 24 | (uint32_t)data[0] << 16 | (uint32_t)data[1] << 8 | data[2];
+	frame_group_t& group = groups[key];
+	if(group.columns.empty())
+	{
+		group.len = data[0];
+		group.addr = data[1];
+		group.cmd = data[2];
+		group.columns.resize(len);
+	}
+
+	if(printDecoded)
+		printFrame(capture, time, data, len);
+
+	group.capture.push_back(capture);
+	group.frame.push_back(captures[capture].frames);
+	group.time.push_back(time);
+	for(uint16_t i = 0; i < len; i++)
+		group.columns[i].push_back(data[i]);
+
+	captures[capture].frames++;
+}
+
+static int hexValue(char c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	else if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	else if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+static void loadText(uint16_t capture, const char *data, size_t size)
+{
+	uint8_t buff[258];
+	const char *end = data + size;
+	while(data < end)
+	{
+		const char *lineEnd = (const char *)memchr(data, '\n', end - data);
+		if(lineEnd == NULL)
+			lineEnd = end;
+
+		// hex bytes separated by spaces until "check" or the end of the line
+		uint16_t len = 0;
+		const char *curr = data;
+		while(curr + 1 < lineEnd && len < sizeof(buff))
+		{
+			int high = hexValue(curr[0]);
+			int low = hexValue(curr[1]);
+			if(high < 0 || low < 0 || (curr + 2 < lineEnd && curr[2] != ' ' && curr[2] != '\r'))
+				break;
+
+			buff[len++] = high << 4 | low;
+			curr += 3;
+		}
+
+		// newer dumps start with 55 AA and end with the checksum
+		uint8_t *frame = buff;
+		if(len >= 2 && buff[0] == 0x55 && buff[1] == 0xAA)
+		{
+			frame += 2;
+			len -= 2;
+		}
+
+		// bytes after the checksum are noise of a collision. Older dumps end
+		// two bytes early, they are kept in their own groups.
+		if(len >= 3 && len >= frame[0] + 4)
+		{
+			uint16_t checksum = frame[frame[0] + 2] | frame[frame[0] + 3] << 8;
+			if(calculateChecksum(frame) == checksum)
+				addFrame(capture, 0, frame, frame[0] + 2);
+			else
+				captures[capture].badFrames++;
+		}
+		else if(len >= 3 && (len == frame[0] + 2 || len == frame[0]))
+		{
+			addFrame(capture, 0, frame, len);
+		}
+
+		data = lineEnd + 1;
+	}
+}
+
+static void loadBinary(uint16_t capture, const uint8_t *data, size_t size)
+{
+	size_t pos = 0;
+	while(pos + RECORD_HEADER_SIZE <= size)
+	{
+		if(data[pos] != 'D' || data[pos + 1] != 'G')
+		{
+			pos++; // resync on the next record
+			continue;
+		}
+
+		uint8_t flags = data[pos + 2];
+		uint32_t time = data[pos + 3] | data[pos + 4] << 8 | data[pos + 5] << 16 | (uint32_t)data[pos + 6] << 24;
+		uint16_t len = data[pos + 7] | data[pos + 8] << 8;
+		pos += RECORD_HEADER_SIZE;
+		if(pos + len > size)
+			break;
+
+		// frames with collisions would only add noise to the statistics
+		if((flags & (RECORD_FLAG_BAD_CHECKSUM | RECORD_FLAG_TRUNCATED)) || len < 5)
+			captures[capture].badFrames++;
+		else
+			addFrame(capture, time, data + pos, len - 2);
+
+		pos += len;
+	}
+}
+
+static bool loadCapture(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat info;
+	if(fd < 0 || fstat(fd, &info) != 0)
+	{
+		perror(path);
+		return false;
+	}
+
+	capture_t capture = {path, 0, 0};
+	captures.push_back(capture);
+	uint16_t index = captures.size() - 1;
+
+	if(info.st_size > 0)
+	{
+		void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data == MAP_FAILED)
+		{
+			perror(path);
+			close(fd);
+			return false;
+		}
+		madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+		const uint8_t *bytes = (const uint8_t *)data;
+		if(info.st_size >= 2 && bytes[0] == 'D' && bytes[1] == 'G')
+			loadBinary(index, bytes, info.st_size);
+		else
+			loadText(index, (const char *)data, info.st_size);
+
+		munmap(data, info.st_size);
+	}
+
+	close(fd);
+	return true;
+}
+
+static bool loadEvents(const char *path, std::vector<event_t>& events)
+{
+	FILE *fd = fopen(path, "r");
+	if(fd == NULL)
+	{
+		perror(path);
+		return false;
+	}
+
+	char capturePath[1024];
+	char label[256];
+	unsigned long frame;
+	while(fscanf(fd, "%1023s %lu %255s", capturePath, &frame, label) == 3)
+	{
+		uint16_t i = 0;
+		while(i < captures.size() && captures[i].path != capturePath)
+			i++;
+
+		if(i == captures.size())
+			fprintf(stderr, "%s: event for unknown capture %s\n", path, capturePath);
+		else
+			events.push_back({i, (uint32_t)frame, label});
+	}
+
+	fclose(fd);
+	return true;
+}
+
+static double entropy(const uint32_t *histogram, size_t count)
+{
+	double result = 0;
+	for(int i = 0; i < 256; i++)
+	{
+		if(histogram[i] == 0)
+			continue;
+
+		double p = (double)histogram[i] / count;
+		result -= p * log2(p);
+	}
+	return result;
+}
+
+// change points are frames whose value differs from the previous frame of
+// the group in the same capture
+static bool isChange(const frame_group_t& group, const std::vector<uint8_t>& column, size_t i)
+{
+	return i > 0 && group.capture[i] == group.capture[i - 1] && column[i] != column[i - 1];
+}
+
+static void printByteStats(const frame_group_t& group, uint32_t maxChanges)
+{
+	size_t count = group.capture.size();
+	printf("\nlen %02X addr %02X cmd %02X: %zu frames%s\n", group.len, group.addr, group.cmd, count,
+		group.columns.size() < (size_t)group.len + 2 ? " (short dumps)" : "");
+
+	for(size_t b = 0; b < group.columns.size(); b++)
+	{
+		const std::vector<uint8_t>& column = group.columns[b];
+		uint32_t histogram[256] = {0};
+		for(uint8_t val : column)
+			histogram[val]++;
+
+		int distinct = 0;
+		for(int i = 0; i < 256; i++)
+			distinct += histogram[i] > 0;
+
+		uint32_t changes = 0;
+		for(size_t i = 1; i < count; i++)
+			changes += isChange(group, column, i);
+
+		printf("  byte %2zu: %3d values, %.2f bits, %u changes", b, distinct, entropy(histogram, count), changes);
+
+		// packets may only differ in the arg, which varies within the group
+		for(const dissector_packet_t& packet : dissectorPackets)
+		{
+			if(packet.length != group.len || packet.address != group.addr
+				|| (packet.command >= 0 && packet.command != group.cmd))
+				continue;
+
+			for(uint8_t i = 0; i < packet.fieldCount; i++)
+			{
+				const dissector_field_t& field = packet.fields[i];
+				if(b < field.offset || b >= (size_t)field.offset + field.width)
+					continue;
+
+				if(packet.arg >= 0)
+					printf(" [%s, arg %02X]", field.name, packet.arg);
+				else
+					printf(" [%s]", field.name);
+			}
+		}
+
+		uint32_t printed = 0;
+		for(size_t i = 1; i < count && printed < maxChanges; i++)
+		{
+			if(!isChange(group, column, i))
+				continue;
+
+			printf("%s %s#%u %02X>%02X", printed == 0 ? " at" : ",",
+				captures[group.capture[i]].path.c_str(), group.frame[i], column[i - 1], column[i]);
+			printed++;
+		}
+		printf("\n");
+	}
+}
+
+typedef struct
+{
+	const frame_group_t *group;
+	size_t byte;
+	uint32_t hits;
+	double baseline;
+} correlation_t;
+
+static void printCorrelations(const std::vector<event_t>& events, uint32_t window)
+{
+	std::map<std::string, std::vector<const event_t *>> labels;
+	for(const event_t& event : events)
+		labels[event.label].push_back(&event);
+
+	uint64_t totalFrames = 0;
+	for(const capture_t& capture : captures)
+		totalFrames += capture.frames;
+
+	for(auto& entry : labels)
+	{
+		const std::vector<const event_t *>& labelEvents = entry.second;
+		std::vector<correlation_t> results;
+
+		for(auto& groupEntry : groups)
+		{
+			const frame_group_t& group = groupEntry.second;
+			for(size_t b = 0; b < group.columns.size(); b++)
+			{
+				const std::vector<uint8_t>& column = group.columns[b];
+
+				uint32_t changes = 0;
+				for(size_t i = 1; i < column.size(); i++)
+					changes += isChange(group, column, i);
+				if(changes == 0)
+					continue;
+
+				uint32_t hits = 0;
+				for(const event_t *event : labelEvents)
+				{
+					// frames of the group are sorted by capture and frame index
+					uint32_t from = event->frame > window ? event->frame - window : 0;
+					uint32_t to = event->frame + window;
+
+					size_t i = 0;
+					size_t lo = 0;
+					size_t hi = column.size();
+					while(lo < hi)
+					{
+						size_t mid = (lo + hi) / 2;
+						if(group.capture[mid] < event->capture
+							|| (group.capture[mid] == event->capture && group.frame[mid] < from))
+							lo = mid + 1;
+						else
+							hi = mid;
+					}
+
+					for(i = lo; i < column.size() && group.capture[i] == event->capture
+						&& group.frame[i] <= to; i++)
+					{
+						if(isChange(group, column, i) && group.frame[i - 1] >= from)
+						{
+							hits++;
+							break;
+						}
+					}
+				}
+
+				// chance of a change inside a random window of the same size
+				double baseline = std::min(1.0, (double)changes * (2 * window + 1) / totalFrames);
+				results.push_back({&group, b, hits, baseline});
+			}
+		}
+
+		std::sort(results.begin(), results.end(), [](const correlation_t& a, const correlation_t& b) {
+			if(a.hits != b.hits)
+				return a.hits > b.hits;
+			return a.baseline < b.baseline;
+		});
+
+		printf("\nevent %s (%zu events, window %u frames):\n", entry.first.c_str(), labelEvents.size(), window);
+		for(size_t i = 0; i < results.size() && i < 20 && results[i].hits > 0; i++)
+		{
+			const correlation_t& result = results[i];
+			printf("  len %02X addr %02X cmd %02X byte %2zu: changed at %u/%zu events, %.1f%% expected\n",
+				result.group->len, result.group->addr, result.group->cmd, result.byte,
+				result.hits, labelEvents.size(), result.baseline * 100);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *eventsPath = NULL;
+	uint32_t window = 50;
+	uint32_t maxChanges = 3;
+
+	int opt;
+	while((opt = getopt(argc, argv, "de:w:n:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'd':
+				printDecoded = true;
+				break;
+			case 'e':
+				eventsPath = optarg;
+				break;
+			case 'w':
+				window = strtoul(optarg, NULL, 10);
+				break;
+			case 'n':
+				maxChanges = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-d] [-e events.txt] [-w window] [-n changes] capture...\n", argv[0]);
+				return 1;
+		}
+	}
+
+	if(optind == argc)
+	{
+		fprintf(stderr, "usage: %s [-d] [-e events.txt] [-w window] [-n changes] capture...\n", argv[0]);
+		return 1;
+	}
+
+	for(int i = optind; i < argc; i++)
+	{
+		if(!loadCapture(argv[i]))
+			return 1;
+	}
+
+	std::vector<event_t> events;
+	if(eventsPath != NULL && !loadEvents(eventsPath, events))
+		return 1;
+
+	for(const capture_t& capture : captures)
+		printf("%s: %u frames, %u with bad checksum\n", capture.path.c_str(), capture.frames, capture.badFrames);
+
+	for(auto& entry : groups)
+		printByteStats(entry.second, maxChanges);
+
+	if(!events.empty())
+		printCorrelations(events, window);
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,583 @@
+// Runs the firmware of TinyTuning or TinyTuningButton in simavr, so RAM and
+// timing regressions and the frames sent on the bus are caught without
+// flashing an ATtiny.
+//
+// build: g++ -O2 -std=c++17 $(pkg-config --cflags simavr) -o tiny-simulator tiny-simulator.cpp $(pkg-config --libs simavr) -lelf
+// usage: ./tiny-simulator [-b] [-f frequency] [-g gap] firmware.elf [sniff...]
+//
+// The firmware is the ELF of the sketch built for the ATtiny85 at 8 MHz, e.g.
+//   arduino-cli compile -b ATTinyCore:avr:attinyx5:chip=85,clock=8internal --output-dir tiny ../TinyTuning
+//   arduino-cli compile -b ATTinyCore:avr:attinyx5:chip=85,clock=8internal --output-dir button ../TinyTuningButton
+//   ./tiny-simulator tiny/TinyTuning.ino.elf ../MegaSniffer/sniffs/sniff-maxspeed.txt
+//   ./tiny-simulator -b button/TinyTuningButton.ino.elf
+// -b is for TinyTuningButton, which doesn't receive.
+// -f sets the clock in Hz, default 8 MHz.
+// -g is the pause between the injected frames in us, default 2000.
+//
+// Every check starts with a freshly reset MCU:
+// - boot: with 0xAA in the EEPROM, TinyTuning sends setMaxSpeed(35) twice (two
+//   clean repeats), TinyTuningButton additionally toggles the eco mode
+// - replay: the frames of the given MegaSniffer text sniffs are sent to the
+//   RX pin at 115200 baud, reporting the cycles per frame spent in the pin
+//   change interrupt and in the main loop while bytes are waiting in the ring,
+//   and the bytes dropped as the ring was full
+// - tuning: 50 input frames with the throttle held send nothing, the 51st
+//   sends setMaxSpeed(35) and the eco mode toggle and writes 0xAA to the EEPROM
+// Frames have to match byte by byte. At the end the static RAM (.data and
+// .bss) and the deepest stack are compared to the 256 byte of the ATtiny45.
+// The exit code is 1 if any check failed.
+//
+// The ring buffer is found by the uartRxHead and uartRxTail symbols of the
+// ELF, without them the main loop cycles and dropped bytes are not reported.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <libelf.h>
+#include <gelf.h>
+
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_irq.h>
+#include <sim_io.h>
+#include <avr_ioport.h>
+#include <avr_eeprom.h>
+
+// calculateChecksum
+#include "../DocGreenDisplay/protocol-core.h"
+
+#define UART_BAUD 115200
+#define UART_TX_PIN 3
+#define UART_RX_PIN 4
+#define BUTTON_RX_PIN 1 // only polled for idle gaps
+
+#define PCINT0_VECTOR_ADDRESS 0x04 // in bytes, vector 2 of 2 bytes each
+#define OPCODE_RETI 0x9518
+#define RAM_START 0x60
+#define ATTINY45_RAM 256
+
+#define INPUT_FRAMES_UNTIL_ACTION 50 // PACKETS_UNTIL_ACTION of TinyTuning.ino
+
+typedef std::vector<uint8_t> frame_t;
+
+// setMaxSpeed(35) and setEcoMode() of TinyTuning/protocol.h as they have to
+// appear on the bus, see docgreen-protocol.md
+static const frame_t maxSpeed35Frame = {0x55, 0xAA, 0x04, 0x22, 0x01, 0xF2, 0x72, 0x03, 0x71, 0xFE};
+static const frame_t ecoOnFrame = {0x55, 0xAA, 0x04, 0x22, 0x01, 0x7C, 0x01, 0x00, 0x5B, 0xFF};
+static const frame_t ecoOffFrame = {0x55, 0xAA, 0x04, 0x22, 0x01, 0x7C, 0x00, 0x00, 0x5C, 0xFF};
+
+static elf_firmware_t firmware;
+static uint32_t frequency = 8000000;
+static uint32_t frameGap = 2000;
+static uint16_t ringHeadAddress = 0;
+static uint16_t ringTailAddress = 0;
+static uint16_t ramEnd;
+static uint16_t minStackPointer = 0xFFFF;
+static bool failed = false;
+
+typedef struct
+{
+	uint64_t cycle;
+	uint8_t level;
+} edge_t;
+
+typedef struct
+{
+	avr_t *avr;
+	double bitCycles;
+
+	// RX line driven by us
+	avr_irq_t *rxIrq;
+	std::vector<edge_t> rxEdges;
+	size_t rxNext;
+	uint8_t rxLevel;
+
+	// TX line, decoded by sampling in the middle of the bits
+	bool txReady; // the pin was high once, it is low while still an input
+	uint8_t txLevel;
+	bool txBusy;
+	uint64_t txStart;
+	uint8_t txBit;
+	uint8_t txVal;
+	frame_t txBytes;
+	uint32_t txFramingErrors;
+
+	// pin change interrupt and main loop
+	bool inIsr;
+	uint64_t isrStart;
+	uint8_t isrHead;
+	uint64_t isrCycles;
+	uint64_t loopCycles; // while bytes were waiting in the ring
+	uint32_t rxBytes;
+	uint32_t droppedBytes;
+} tiny_sim_t;
+
+//
+// firmware
+//
+
+// returns the data address of a variable or 0, LTO may add a suffix like .lto_priv.0
+static uint16_t findSymbol(const char *path, const char *name)
+{
+	int fd = open(path, O_RDONLY);
+	if(fd < 0 || elf_version(EV_CURRENT) == EV_NONE)
+		return 0;
+
+	Elf *elf = elf_begin(fd, ELF_C_READ, NULL);
+	size_t nameLen = strlen(name);
+	uint16_t address = 0;
+	Elf_Scn *scn = NULL;
+	while(elf != NULL && address == 0 && (scn = elf_nextscn(elf, scn)) != NULL)
+	{
+		GElf_Shdr shdr;
+		if(gelf_getshdr(scn, &shdr) == NULL || shdr.sh_type != SHT_SYMTAB || shdr.sh_entsize == 0)
+			continue;
+
+		Elf_Data *data = elf_getdata(scn, NULL);
+		for(size_t i = 0; data != NULL && i < shdr.sh_size / shdr.sh_entsize; i++)
+		{
+			GElf_Sym sym;
+			if(gelf_getsym(data, i, &sym) == NULL)
+				continue;
+
+			const char *symName = elf_strptr(elf, shdr.sh_link, sym.st_name);
+			if(symName != NULL && strncmp(symName, name, nameLen) == 0
+				&& (symName[nameLen] == 0 || symName[nameLen] == '.'))
+			{
+				address = sym.st_value & 0xFFFF; // the data space starts at 0x800000
+				break;
+			}
+		}
+	}
+
+	if(elf != NULL)
+		elf_end(elf);
+	close(fd);
+	return address;
+}
+
+//
+// simulation
+//
+
+static void simTxNotify(avr_irq_t *, uint32_t value, void *param)
+{
+	tiny_sim_t *sim = (tiny_sim_t *)param;
+	sim->txLevel = value != 0;
+	if(!sim->txReady)
+	{
+		sim->txReady = sim->txLevel;
+		return;
+	}
+
+	if(!sim->txBusy && sim->txLevel == 0)
+	{
+		sim->txBusy = true;
+		sim->txStart = sim->avr->cycle;
+		sim->txBit = 0;
+		sim->txVal = 0;
+	}
+}
+
+static void simStart(tiny_sim_t& sim, uint8_t rxPin, uint8_t eepromValue)
+{
+	sim = tiny_sim_t();
+	sim.avr = avr_make_mcu_by_name("attiny85");
+	if(sim.avr == NULL)
+	{
+		fprintf(stderr, "simavr has no attiny85\n");
+		exit(1);
+	}
+
+	avr_init(sim.avr);
+	avr_load_firmware(sim.avr, &firmware);
+	sim.avr->frequency = frequency;
+	ramEnd = sim.avr->ramend;
+	sim.bitCycles = (double)frequency / UART_BAUD;
+
+	avr_eeprom_desc_t eeprom = {&eepromValue, 0, 1};
+	avr_ioctl(sim.avr, AVR_IOCTL_EEPROM_SET, &eeprom);
+
+	// the bus idles high
+	sim.rxIrq = avr_io_getirq(sim.avr, AVR_IOCTL_IOPORT_GETIRQ('B'), rxPin);
+	sim.rxLevel = 1;
+	avr_raise_irq(sim.rxIrq, 1);
+
+	avr_irq_register_notify(avr_io_getirq(sim.avr, AVR_IOCTL_IOPORT_GETIRQ('B'), UART_TX_PIN),
+		simTxNotify, &sim);
+}
+
+static void simStop(tiny_sim_t& sim)
+{
+	avr_terminate(sim.avr);
+	sim.avr = NULL;
+}
+
+static bool simRingEmpty(tiny_sim_t& sim)
+{
+	return ringHeadAddress == 0 || sim.avr->data[ringHeadAddress] == sim.avr->data[ringTailAddress];
+}
+
+static void simStep(tiny_sim_t& sim)
+{
+	avr_t *avr = sim.avr;
+	while(sim.rxNext < sim.rxEdges.size() && sim.rxEdges[sim.rxNext].cycle <= avr->cycle)
+	{
+		avr_raise_irq(sim.rxIrq, sim.rxEdges[sim.rxNext].level);
+		sim.rxNext++;
+	}
+
+	uint64_t before = avr->cycle;
+	uint32_t pc = avr->pc;
+	bool reti = (avr->flash[pc] | (avr->flash[pc + 1] << 8)) == OPCODE_RETI;
+	bool waiting = !simRingEmpty(sim);
+
+	int state = avr_run(avr);
+	if(state == cpu_Done || state == cpu_Crashed)
+	{
+		fprintf(stderr, "the MCU stopped at pc 0x%04x, cycle %llu\n", pc, (unsigned long long)avr->cycle);
+		exit(1);
+	}
+
+	if(sim.inIsr)
+	{
+		if(reti)
+		{
+			// shorter ones returned on a rising edge, not a start bit
+			uint64_t cycles = avr->cycle - sim.isrStart;
+			sim.inIsr = false;
+			sim.isrCycles += cycles;
+			if(cycles > sim.bitCycles)
+			{
+				sim.rxBytes++;
+				if(ringHeadAddress != 0 && avr->data[ringHeadAddress] == sim.isrHead)
+					sim.droppedBytes++;
+			}
+		}
+	}
+	else if(avr->pc == PCINT0_VECTOR_ADDRESS)
+	{
+		sim.inIsr = true;
+		sim.isrStart = avr->cycle;
+		sim.isrHead = ringHeadAddress != 0 ? avr->data[ringHeadAddress] : 0;
+	}
+	else if(waiting)
+	{
+		sim.loopCycles += avr->cycle - before;
+	}
+
+	uint16_t sp = avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+	if(sp >= RAM_START && sp < minStackPointer)
+		minStackPointer = sp;
+
+	if(sim.txBusy && avr->cycle >= sim.txStart + (1.5 + sim.txBit) * sim.bitCycles)
+	{
+		if(sim.txBit < 8)
+		{
+			sim.txVal |= sim.txLevel << sim.txBit;
+			sim.txBit++;
+		}
+		else
+		{
+			if(!sim.txLevel)
+				sim.txFramingErrors++;
+			sim.txBytes.push_back(sim.txVal);
+			sim.txBusy = false;
+		}
+	}
+}
+
+static void simRun(tiny_sim_t& sim, uint32_t ms)
+{
+	uint64_t end = sim.avr->cycle + (uint64_t)frequency * ms / 1000;
+	while(sim.avr->cycle < end)
+		simStep(sim);
+}
+
+// runs until all queued frames were sent, then for ms
+static void simRunFrames(tiny_sim_t& sim, uint32_t ms)
+{
+	while(sim.rxNext < sim.rxEdges.size())
+		simStep(sim);
+	simRun(sim, ms);
+}
+
+// queues a frame after frameGap, bytes follow each other without a pause
+static void simQueueFrame(tiny_sim_t& sim, const frame_t& frame)
+{
+	uint64_t last = sim.rxEdges.empty() ? 0 : sim.rxEdges.back().cycle;
+	double time = std::max(last, sim.avr->cycle) + (double)frequency * frameGap / 1000000;
+
+	auto edge = [&](double at, uint8_t level) {
+		if(level != sim.rxLevel)
+			sim.rxEdges.push_back({(uint64_t)at, level});
+		sim.rxLevel = level;
+	};
+	for(uint8_t val : frame)
+	{
+		edge(time, 0); // start bit
+		for(uint8_t i = 0; i < 8; i++)
+			edge(time + (1 + i) * sim.bitCycles, (val >> i) & 1);
+		edge(time + 9 * sim.bitCycles, 1); // stop bit
+		time += 10 * sim.bitCycles;
+	}
+}
+
+//
+// checks
+//
+
+static void printFrame(const char *prefix, const frame_t& frame)
+{
+	printf("%s", prefix);
+	for(uint8_t val : frame)
+		printf(" %02X", val);
+	printf("\n");
+}
+
+static void checkSent(const char *name, tiny_sim_t& sim, const std::vector<frame_t>& expected)
+{
+	frame_t wanted;
+	for(const frame_t& frame : expected)
+		wanted.insert(wanted.end(), frame.begin(), frame.end());
+
+	if(sim.txBytes == wanted && sim.txFramingErrors == 0)
+	{
+		printf("%s: ok, %zu frames\n", name, expected.size());
+		return;
+	}
+
+	printf("%s: FAILED, %u framing errors\n", name, sim.txFramingErrors);
+	printFrame("  expected:", wanted);
+	printFrame("  sent:    ", sim.txBytes);
+	failed = true;
+}
+
+static void printCycles(const char *name, tiny_sim_t& sim, size_t frames, size_t bytes)
+{
+	printf("%s: %zu frames, %zu bytes, %.0f interrupt cycles/frame", name, frames, bytes,
+		frames == 0 ? 0.0 : (double)sim.isrCycles / frames);
+	if(ringHeadAddress != 0)
+	{
+		printf(", %.0f main loop cycles/frame, %u of %u bytes dropped",
+			frames == 0 ? 0.0 : (double)sim.loopCycles / frames, sim.droppedBytes, sim.rxBytes);
+		if(sim.droppedBytes != 0)
+			failed = true;
+	}
+	printf("\n");
+}
+
+static void checkBoot(bool button)
+{
+	tiny_sim_t sim;
+	simStart(sim, button ? BUTTON_RX_PIN : UART_RX_PIN, 0xAA);
+
+	// the button waits 2 s before and 1 s between the eco mode frames
+	if(button)
+	{
+		simRun(sim, 3500);
+		checkSent("boot", sim, {maxSpeed35Frame, maxSpeed35Frame,
+			ecoOnFrame, ecoOnFrame, ecoOffFrame, ecoOffFrame});
+	}
+	else
+	{
+		simRun(sim, 200);
+		checkSent("boot", sim, {maxSpeed35Frame, maxSpeed35Frame});
+	}
+
+	simStop(sim);
+}
+
+static int hexValue(char c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	else if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	else if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+// frames of a MegaSniffer text sniff, one per line with or without 55 AA and
+// the checksum, e.g. "07 25 60 05 04 2C 2C 00 00 check FF12"
+static bool loadSniff(const char *path, std::vector<frame_t>& frames)
+{
+	FILE *fd = fopen(path, "r");
+	if(fd == NULL)
+	{
+		perror(path);
+		return false;
+	}
+
+	char line[1024];
+	while(fgets(line, sizeof(line), fd) != NULL)
+	{
+		uint8_t buff[260];
+		size_t len = 0;
+		char *curr = line;
+		while(len < sizeof(buff) && hexValue(curr[0]) >= 0 && hexValue(curr[1]) >= 0
+			&& (curr[2] == ' ' || curr[2] == '\r' || curr[2] == '\n' || curr[2] == 0))
+		{
+			buff[len++] = hexValue(curr[0]) << 4 | hexValue(curr[1]);
+			curr += curr[2] == 0 ? 2 : 3;
+		}
+
+		uint8_t *data = buff;
+		if(len >= 2 && buff[0] == 0x55 && buff[1] == 0xAA)
+		{
+			data += 2;
+			len -= 2;
+		}
+		if(len < 3 || len < (size_t)data[0] + 2)
+			continue;
+
+		frame_t frame = {0x55, 0xAA};
+		if(len >= (size_t)data[0] + 4)
+		{
+			frame.insert(frame.end(), data, data + data[0] + 4); // as recorded
+		}
+		else
+		{
+			uint16_t checksum = calculateChecksum(data);
+			frame.insert(frame.end(), data, data + data[0] + 2);
+			frame.push_back(checksum & 0xFF);
+			frame.push_back(checksum >> 8);
+		}
+		frames.push_back(frame);
+	}
+
+	fclose(fd);
+	return true;
+}
+
+static void checkReplay(const std::vector<frame_t>& frames)
+{
+	tiny_sim_t sim;
+	simStart(sim, UART_RX_PIN, 0x00);
+	simRun(sim, 50);
+	sim.isrCycles = 0;
+	sim.loopCycles = 0;
+
+	size_t bytes = 0;
+	for(const frame_t& frame : frames)
+	{
+		simQueueFrame(sim, frame);
+		bytes += frame.size();
+	}
+	simRunFrames(sim, 10);
+
+	printCycles("replay", sim, frames.size(), bytes);
+	if(!sim.txBytes.empty())
+		printf("  the sniffs made the firmware send %zu bytes, the cycles include them\n", sim.txBytes.size());
+
+	simStop(sim);
+}
+
+static void checkTuning()
+{
+	tiny_sim_t sim;
+	simStart(sim, UART_RX_PIN, 0x00);
+	simRun(sim, 50);
+	sim.isrCycles = 0;
+	sim.loopCycles = 0;
+
+	// throttle held at A0, brake released, see the input frame in docgreen-protocol.md
+	frame_t input = {0x55, 0xAA, 0x07, 0x25, 0x60, 0x05, 0x04, 0xA0, 0x2C, 0x00, 0x00, 0x00, 0x00};
+	uint16_t checksum = calculateChecksum(input.data() + 2);
+	input[11] = checksum & 0xFF;
+	input[12] = checksum >> 8;
+
+	for(int i = 0; i < INPUT_FRAMES_UNTIL_ACTION; i++)
+		simQueueFrame(sim, input);
+	simRunFrames(sim, 50);
+	printCycles("input frames", sim, INPUT_FRAMES_UNTIL_ACTION, INPUT_FRAMES_UNTIL_ACTION * input.size());
+	checkSent("tuning, throttle held for 50 frames", sim, {});
+
+	simQueueFrame(sim, input);
+	simRunFrames(sim, 1500);
+	checkSent("tuning, throttle held for 51 frames", sim, {maxSpeed35Frame, maxSpeed35Frame,
+		ecoOnFrame, ecoOnFrame, ecoOffFrame, ecoOffFrame});
+
+	uint8_t eepromValue = 0;
+	avr_eeprom_desc_t eeprom = {&eepromValue, 0, 1};
+	avr_ioctl(sim.avr, AVR_IOCTL_EEPROM_GET, &eeprom);
+	if(eepromValue != 0xAA)
+	{
+		printf("tuning: FAILED, EEPROM is %02X instead of AA\n", eepromValue);
+		failed = true;
+	}
+
+	simStop(sim);
+}
+
+static int usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b] [-f frequency] [-g gap] firmware.elf [sniff...]\n", name);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	bool button = false;
+
+	int opt;
+	while((opt = getopt(argc, argv, "bf:g:")) != -1)
+	{
+		if(opt == 'b')
+			button = true;
+		else if(opt == 'f')
+			frequency = atol(optarg);
+		else if(opt == 'g')
+			frameGap = atol(optarg);
+		else
+			return usage(argv[0]);
+	}
+	if(optind >= argc)
+		return usage(argv[0]);
+
+	const char *path = argv[optind];
+	if(elf_read_firmware(path, &firmware) != 0)
+	{
+		fprintf(stderr, "%s: can't read the firmware\n", path);
+		return 1;
+	}
+
+	std::vector<frame_t> frames;
+	for(int i = optind + 1; i < argc; i++)
+	{
+		if(!loadSniff(argv[i], frames))
+			return 1;
+	}
+
+	ringHeadAddress = findSymbol(path, "uartRxHead");
+	ringTailAddress = findSymbol(path, "uartRxTail");
+	if(ringTailAddress == 0)
+		ringHeadAddress = 0;
+
+	checkBoot(button);
+	if(!button)
+	{
+		if(!frames.empty())
+			checkReplay(frames);
+		checkTuning();
+	}
+
+	// the ATtiny85 has twice the RAM, the stack depth is the same on both
+	uint32_t staticRam = firmware.datasize + firmware.bsssize;
+	uint32_t stack = ramEnd - minStackPointer;
+	int32_t headroom = ATTINY45_RAM - (int32_t)(staticRam + stack);
+	printf("RAM: %u byte static (.data %u, .bss %u), %u byte stack, %d byte left on the ATtiny45\n",
+		staticRam, firmware.datasize, firmware.bsssize, stack, headroom);
+	if(headroom < 0)
+		failed = true;
+
+	return failed ? 1 : 0;
+}
\ No newline at end of file
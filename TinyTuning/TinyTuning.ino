@@ -9,7 +9,7 @@ static uint8_t brakePressDuration = 0;
 
 void setup()
 {
-	ScooterSerial.begin(115200);
+	ScooterSerial.begin();
 
 	scooterStatus.isTuned = EEPROM.read(0) == 0xAA;
 	if(scooterStatus.isTuned)
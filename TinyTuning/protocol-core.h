@@ -0,0 +1 @@
+../DocGreenDisplay/protocol-core.h
\ No newline at end of file
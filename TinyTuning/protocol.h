@@ -1,22 +1,10 @@
 #pragma once
 
 #include <stdint.h>
-#include <SoftwareSerial.h>
-
-// send a packet multiple times with small delays to make sure it arrived
-// even when one of them collided with another packet on the bus
-#define SEND_REPEAT(func) do { \
-		delay(7); \
-		func; \
-		delay(13); \
-		func; \
-		delay(5); \
-		func; \
-	} while(0)
 
 // we could use protocol.h from DocGreenDisplay, but it's docgreen_status_t
 // structure alone needs 12% of the ATtiny's RAM (31 of 256 byte)
-// thus below are parts rewritten without using buffers or large structs
+// thus only the parser core is shared and decodes just the fields below
 
 #ifndef UART_TX_PIN
 #define UART_TX_PIN 3
@@ -24,7 +12,60 @@
 #ifndef UART_RX_PIN
 #define UART_RX_PIN 4
 #endif
-SoftwareSerial ScooterSerial(UART_RX_PIN, UART_TX_PIN);
+#include "./tiny-uart.h"
+#include "./protocol-core.h"
+TinyUart ScooterSerial;
+
+// the bus idles high and the bytes of a frame follow each other without a
+// pause, so the RX pin staying high for a few byte times means no frame is in
+// progress and ours won't collide with one
+#define BUS_IDLE_WINDOW 300 // us, about 3.5 byte times at 115200 baud
+#define BUS_IDLE_TIMEOUT 20 // ms, send anyway if the bus never goes quiet
+
+// a packet is repeated until it went out into an idle bus twice, but at most
+// three times like before
+#define SEND_CLEAN_REPEATS 2
+#define SEND_MAX_REPEATS 3
+
+static bool waitForBusIdle()
+{
+	// the pin is polled directly, the sending function listens again
+	ScooterSerial.stopListening();
+
+	uint32_t start = millis();
+	uint32_t quietSince = micros();
+	while(millis() - start < BUS_IDLE_TIMEOUT)
+	{
+		// a start bit is only 8.7us long, check the pin several times for
+		// every call to micros()
+		bool busy = false;
+		for(uint8_t i = 0; i < 8; i++)
+		{
+			if(!(PINB & _BV(UART_RX_PIN)))
+				busy = true;
+		}
+
+		uint32_t now = micros();
+		if(busy)
+			quietSince = now;
+		else if(now - quietSince >= BUS_IDLE_WINDOW)
+			return true;
+	}
+
+	return false;
+}
+
+// send a packet multiple times to make sure it arrived even when one of
+// them collided with another packet on the bus
+#define SEND_REPEAT(func) do { \
+		uint8_t clean = 0; \
+		for(uint8_t i = 0; i < SEND_MAX_REPEATS && clean < SEND_CLEAN_REPEATS; i++) \
+		{ \
+			if(waitForBusIdle()) \
+				clean++; \
+			func; \
+		} \
+	} while(0)
 
 typedef struct
 {
@@ -66,7 +107,7 @@ void setMaxSpeed(uint8_t speed)
 	ScooterSerial.write(data, sizeof(data) / sizeof(uint8_t));
 	sendUint16LE(rpm);
 	sendUint16LE(checksum);
-	//ScooterSerial.listen();
+	ScooterSerial.listen();
 }
 
 static void setOption(uint8_t id, bool enabled)
@@ -87,7 +128,7 @@ static void setOption(uint8_t id, bool enabled)
 	ScooterSerial.write(enabled ? (uint8_t)0x01 : (uint8_t)0x00);
 	ScooterSerial.write((uint8_t)0x00);
 	sendUint16LE(checksum);
-	//ScooterSerial.listen();
+	ScooterSerial.listen();
 }
 inline void setEcoMode(bool enabled)
 {
@@ -102,74 +143,29 @@ inline void setLight(bool enabled)
 	setOption(0xF0, enabled);
 }
 
-uint8_t readWithDefault()
-{
-	// give the scooter some time
-	if(!ScooterSerial.available())
-		delay(1);
-
-	if(ScooterSerial.available())
-		return ScooterSerial.read();
-	else
-		return 0x00;
-}
-bool receivePacket(docgreen_tiny_status_t& status)
-{
-	if(readWithDefault() != 0x55)
-		return false;
-	if(readWithDefault() != 0xAA)
-		return false;
+#ifndef UART_TX_ONLY
+#define TINY_STATUS_FIELDS (DOCGREEN_THROTTLE | DOCGREEN_BRAKE | DOCGREEN_SPEED \
+	| DOCGREEN_ECO_MODE | DOCGREEN_LIGHTS | DOCGREEN_BUTTON_PRESS)
 
-	uint8_t len = readWithDefault();
-	uint8_t addr = readWithDefault();
-	if(len == 0 || (addr != 0x25 && addr != 0x28))
-		return false;
+static docgreen_parser_t<TINY_STATUS_FIELDS, docgreen_tiny_status_t> parser;
 
-	uint16_t sum = len;
-	sum += addr;
-	len += 2;
+// the ATtiny45 has 256 byte of RAM, catch the receive path growing at compile
+// time as there is no way to check the footprint without flashing a device
+#define BUS_RAM_BUDGET 32
+static_assert(sizeof(uartRxBuffer) + sizeof(uartRxHead) + sizeof(uartRxTail)
+	+ sizeof(parser) <= BUS_RAM_BUDGET, "Bus receive state exceeds its RAM budget.");
 
-	for(int i = 2; i < len; i++)
+// consumes the received bytes without blocking, returns true when a valid
+// frame was completed and its values were applied to status
+bool receivePacket(docgreen_tiny_status_t& status)
+{
+	while(ScooterSerial.available())
 	{
-		uint8_t val = readWithDefault();
-		sum += val;
-
-		if(addr == 0x25) // input info packet
-		{
-			if(i == 2 && val != 0x60)
-				return false;
-			else if(i == 5)
-				status.throttle = val;
-			else if(i == 6)
-				status.brake = val;
-		}
-		else if(addr == 0x28)
-		{
-			switch(i)
-			{
-				case 4:
-					status.ecoMode = val == 0x02;
-					break;
-				case 6:
-					status.lights = val == 0x01;
-					break;
-				case 8:
-					status.speed = (uint16_t)val << 8;
-					break;
-				case 9:
-					status.speed |= val;
-					break;
-				case 10:
-					status.buttonPress = val == 0x01;
-					break;
-			}
-		}
+		if(parser.feed(status, ScooterSerial.read()))
+			return true;
 	}
 
-	uint16_t actualChecksum = (uint16_t)readWithDefault() | ((uint16_t)readWithDefault() << 8);
-	sum ^= 0xFFFF;
-	if(actualChecksum != sum)
-		return false;
-
-	return true;
+	return false;
 }
+
+#endif
\ No newline at end of file
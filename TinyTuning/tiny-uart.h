@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// Minimal software UART for the ATtiny45/85 replacing SoftwareSerial, whose
+// 64 byte receive buffer alone needs a quarter of the RAM. Bytes are received
+// by the pin change interrupt of the RX pin into a small ring buffer, sending
+// blocks with interrupts disabled for one byte at a time.
+//
+// Both pins have to be on PORTB, which is the only port of the ATtiny45/85,
+// UART_RX_PIN and UART_TX_PIN are the bit numbers (= Arduino pin numbers).
+//
+// With UART_TX_ONLY defined the receive path (ISR, ring) is compiled out,
+// the RX pin is then only configured as input for polling it directly.
+
+#ifndef UART_BAUD
+#define UART_BAUD 115200
+#endif
+
+// has to be a power of two, the ring needs UART_RX_BUFFER_SIZE + 2 bytes of RAM
+#ifndef UART_RX_BUFFER_SIZE
+#define UART_RX_BUFFER_SIZE 16
+#endif
+
+#define UART_BIT_CYCLES (F_CPU / UART_BAUD)
+
+// cycles spent outside of the delays, from the start edge to the first
+// instruction of the ISR and per bit in the receive and send loops
+#define UART_RX_ISR_LATENCY 24
+#define UART_RX_LOOP_CYCLES 8
+#define UART_TX_LOOP_CYCLES 10
+
+static_assert((UART_RX_BUFFER_SIZE & (UART_RX_BUFFER_SIZE - 1)) == 0,
+	"UART_RX_BUFFER_SIZE has to be a power of two.");
+static_assert(UART_BIT_CYCLES > UART_TX_LOOP_CYCLES + 16,
+	"F_CPU is too low for UART_BAUD.");
+
+#ifndef UART_TX_ONLY
+
+static volatile uint8_t uartRxBuffer[UART_RX_BUFFER_SIZE];
+static volatile uint8_t uartRxHead = 0; // written by the ISR
+static volatile uint8_t uartRxTail = 0; // written by read()
+
+ISR(PCINT0_vect)
+{
+	// only the falling edge of the start bit is of interest
+	if(PINB & _BV(UART_RX_PIN))
+		return;
+
+	// sample in the middle of the data bits
+	__builtin_avr_delay_cycles(UART_BIT_CYCLES * 3 / 2 - UART_RX_ISR_LATENCY);
+
+	uint8_t val = 0;
+	for(uint8_t i = 0; i < 8; i++)
+	{
+		val >>= 1;
+		if(PINB & _BV(UART_RX_PIN))
+			val |= 0x80;
+
+		__builtin_avr_delay_cycles(UART_BIT_CYCLES - UART_RX_LOOP_CYCLES);
+	}
+
+	// drop the byte if the main loop didn't keep up, the parser resyncs on
+	// the next frame header
+	uint8_t next = (uartRxHead + 1) & (UART_RX_BUFFER_SIZE - 1);
+	if(next != uartRxTail)
+	{
+		uartRxBuffer[uartRxHead] = val;
+		uartRxHead = next;
+	}
+
+	// we are in the stop bit now, forget the edges of the data bits
+	GIFR = _BV(PCIF);
+}
+#endif
+
+struct TinyUart
+{
+	void begin()
+	{
+		PORTB |= _BV(UART_TX_PIN);
+		DDRB |= _BV(UART_TX_PIN);
+		DDRB &= ~_BV(UART_RX_PIN);
+		PORTB |= _BV(UART_RX_PIN);
+
+#ifndef UART_TX_ONLY
+		GIMSK |= _BV(PCIE);
+		listen();
+#endif
+	}
+
+#ifdef UART_TX_ONLY
+	void listen() {}
+	void stopListening() {}
+#else
+	void listen()
+	{
+		GIFR = _BV(PCIF);
+		PCMSK |= _BV(UART_RX_PIN);
+	}
+	void stopListening()
+	{
+		PCMSK &= ~_BV(UART_RX_PIN);
+	}
+
+	uint8_t available()
+	{
+		return (uartRxHead - uartRxTail) & (UART_RX_BUFFER_SIZE - 1);
+	}
+	uint8_t read()
+	{
+		uint8_t val = uartRxBuffer[uartRxTail];
+		uartRxTail = (uartRxTail + 1) & (UART_RX_BUFFER_SIZE - 1);
+		return val;
+	}
+#endif
+
+	void write(uint8_t val)
+	{
+		uint8_t oldSREG = SREG;
+		cli();
+
+		PORTB &= ~_BV(UART_TX_PIN);
+		__builtin_avr_delay_cycles(UART_BIT_CYCLES - UART_TX_LOOP_CYCLES);
+
+		for(uint8_t i = 0; i < 8; i++)
+		{
+			if(val & 1)
+				PORTB |= _BV(UART_TX_PIN);
+			else
+				PORTB &= ~_BV(UART_TX_PIN);
+
+			val >>= 1;
+			__builtin_avr_delay_cycles(UART_BIT_CYCLES - UART_TX_LOOP_CYCLES);
+		}
+
+		PORTB |= _BV(UART_TX_PIN);
+		__builtin_avr_delay_cycles(UART_BIT_CYCLES);
+
+		SREG = oldSREG;
+	}
+	void write(const uint8_t *data, uint8_t len)
+	{
+		for(uint8_t i = 0; i < len; i++)
+			write(data[i]);
+	}
+};
\ No newline at end of file
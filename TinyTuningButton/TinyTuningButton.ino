@@ -1,7 +1,9 @@
 #include <stdint.h>
 #include <EEPROM.h>
 
+// write-only, the RX pin is only polled to find idle gaps of the bus
 #define UART_RX_PIN 1
+#define UART_TX_ONLY
 #include "./protocol.h"
 
 static bool isTuned = false;
@@ -40,8 +42,7 @@ void setup()
 	pinMode(2, INPUT_PULLUP);
 	attachInterrupt(0, buttonInterrupt, CHANGE);
 
-	ScooterSerial.begin(115200);
-	ScooterSerial.stopListening();
+	ScooterSerial.begin();
 
 	delay(2000);
 
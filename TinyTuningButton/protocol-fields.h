@@ -0,0 +1 @@
+../DocGreenDisplay/protocol-fields.h
\ No newline at end of file
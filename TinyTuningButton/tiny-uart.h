@@ -0,0 +1 @@
+../TinyTuning/tiny-uart.h
\ No newline at end of file
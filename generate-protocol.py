@@ -0,0 +1,257 @@
+import os, re, json
+
+# Generates everything describing the decoded fields of the bus protocol from
+# docgreen-protocol.json:
+# - DocGreenDisplay/protocol-fields.h: field masks and the decoder used by
+#   protocol-core.h, shared with the ATtiny builds through symlinks
+# - SniffAnalyzer/dissector.h: field table of the sniff analysis tool
+# - the field tables at the end of docgreen-protocol.md
+#
+# A field is one line in the json, numbers may be given as hex strings:
+#   name: member of the target's status struct
+#   offset: index of the first byte as in docgreen-protocol.md
+#   type: uint, int or flag (true when the byte equals "on")
+#   width: bytes (default 1), endian: little (default) or big
+#   scale, unit: raw value * scale gives the value in unit (docs and analyzer)
+
+MD_BEGIN = "<!-- generated by generate-protocol.py, do not edit below -->"
+
+path = os.path.dirname(os.path.abspath(__file__))
+
+def number(val):
+    if isinstance(val, str):
+        return int(val, 0)
+    return val
+
+def macroName(name):
+    return re.sub("([a-z0-9])([A-Z])", "\\1_\\2", name).upper()
+
+with open(os.path.join(path, "docgreen-protocol.json")) as fd:
+    schema = json.load(fd)
+
+packets = schema["packets"]
+fields = []
+for packet in packets:
+    packet["address"] = number(packet["address"])
+    packet["length"] = number(packet["length"])
+    packet["command"] = number(packet["command"]) if "command" in packet else None
+    packet["arg"] = number(packet["arg"]) if "arg" in packet else None
+
+    for field in packet["fields"]:
+        field["packet"] = packet
+        field["offset"] = number(field["offset"])
+        field["width"] = number(field.get("width", 1))
+        field["endian"] = field.get("endian", "little")
+        field["macro"] = "DOCGREEN_" + macroName(field["name"])
+        if field["type"] == "flag":
+            field["on"] = number(field["on"])
+            assert field["width"] == 1, field["name"]
+        assert field["type"] in ("uint", "int", "flag"), field["name"]
+        assert 4 <= field["offset"] and field["offset"] + field["width"] <= packet["length"] + 2, field["name"]
+        fields.append(field)
+
+assert len(fields) <= 31, "bit 31 is DOCGREEN_ALL_FRAMES"
+
+# packets sharing address and length may only be told apart by their arg
+groups = []
+for packet in packets:
+    group = next((g for g in groups if g[0]["address"] == packet["address"]
+        and g[0]["length"] == packet["length"]), None)
+    if group is None:
+        groups.append([packet])
+    else:
+        assert group[0]["command"] == packet["command"], packet["name"]
+        assert packet["arg"] is not None and group[0]["arg"] is not None, packet["name"]
+        group.append(packet)
+
+def mask(packet):
+    return "DOCGREEN_{}_FIELDS".format(packet["name"])
+
+def groupMask(group):
+    if len(group) == 1:
+        return mask(group[0])
+    return "(" + " | ".join(mask(p) for p in group) + ")"
+
+def fieldOf(field):
+    return "DOCGREEN_FIELD_OF({}, {})".format(field["name"], field["macro"])
+
+#
+# decoder
+#
+out = "#pragma once\n\n"
+out += "// autogenerated by generate-protocol.py from docgreen-protocol.json, do not edit\n"
+out += "// included by protocol-core.h, which defines the macros used below\n\n"
+
+bit = 0
+for packet in packets:
+    out += "// {}, address {:02X}".format(packet["title"], packet["address"])
+    if packet["command"] is not None:
+        out += " command {:02X}".format(packet["command"])
+    if packet["arg"] is not None:
+        out += " arg {:02X}".format(packet["arg"])
+    out += "\n"
+    for field in packet["fields"]:
+        out += "#define {} (1UL << {})\n".format(field["macro"], bit)
+        bit += 1
+out += "\n"
+
+for packet in packets:
+    out += "#define {} ({})\n".format(mask(packet), " | ".join(f["macro"] for f in packet["fields"]))
+out += "\n"
+
+out += "typedef enum : uint8_t\n{\n\tDOCGREEN_PACKET_NONE,\n"
+for packet in packets:
+    out += "\tDOCGREEN_PACKET_{},\n".format(packet["name"])
+out += "} docgreen_packet_t;\n\n"
+
+for field in fields:
+    if field["type"] == "flag":
+        out += "DOCGREEN_FLAG_FIELD({}, {:#04x})\n".format(field["name"], field["on"])
+    else:
+        out += "DOCGREEN_INT_FIELD({})\n".format(field["name"])
+out += "\n"
+
+# longest selected packet, longer frames can be dropped early
+out += "constexpr uint8_t docgreenMaxLength(uint32_t fields)\n{\n\treturn "
+for packet in sorted(packets, key=lambda p: -p["length"]):
+    out += "(fields & {}) ? {:#04x}\n\t\t: ".format(mask(packet), packet["length"])
+out += "0;\n}\n\n"
+
+# i is 1 for the address, 2 for the command and 3 for the arg
+out += "template<uint32_t Fields>\n"
+out += "docgreen_packet_t docgreenSelectPacket(docgreen_packet_t packet, uint8_t len, uint8_t i, uint8_t val)\n{\n"
+out += "\tif(i == 1)\n\t{\n"
+for group in groups:
+    out += "\t\tif((Fields & {}) && val == {:#04x} && len == {:#04x})\n".format(
+        groupMask(group), group[0]["address"], group[0]["length"])
+    out += "\t\t\treturn DOCGREEN_PACKET_{};\n".format(group[0]["name"])
+out += "\t\treturn DOCGREEN_PACKET_NONE;\n\t}\n"
+
+out += "\telse if(i == 2)\n\t{\n"
+for group in groups:
+    if group[0]["command"] is not None:
+        out += "\t\tif(packet == DOCGREEN_PACKET_{} && val != {:#04x})\n".format(group[0]["name"], group[0]["command"])
+        out += "\t\t\treturn DOCGREEN_PACKET_NONE;\n"
+out += "\t}\n"
+
+out += "\telse if(i == 3)\n\t{\n"
+for group in groups:
+    if group[0]["arg"] is None:
+        continue
+    out += "\t\tif(packet == DOCGREEN_PACKET_{})\n\t\t{{\n".format(group[0]["name"])
+    for packet in group:
+        out += "\t\t\tif((Fields & {}) && val == {:#04x})\n".format(mask(packet), packet["arg"])
+        out += "\t\t\t\treturn DOCGREEN_PACKET_{};\n".format(packet["name"])
+    out += "\t\t\treturn DOCGREEN_PACKET_NONE;\n\t\t}\n"
+out += "\t}\n\n\treturn packet;\n}\n\n"
+
+# one switch over the byte index per packet, multi byte fields are assembled
+# byte by byte so there are no unaligned reads
+out += "template<uint32_t Fields, typename Status>\n"
+out += "void docgreenDecode(docgreen_packet_t packet, Status& staged, uint8_t i, uint8_t val)\n{\n"
+out += "\tswitch(packet)\n\t{\n"
+for packet in packets:
+    out += "\t\tcase DOCGREEN_PACKET_{}:\n\t\t\tswitch(i)\n\t\t\t{{\n".format(packet["name"])
+    for field in packet["fields"]:
+        first = field["offset"]
+        last = first + field["width"] - 1
+        out += "\t\t\t\t" + " ".join("case {}:".format(i) for i in range(first, last + 1)) + "\n"
+        if field["width"] == 1:
+            k = "0"
+            isFirst = "true"
+        elif field["endian"] == "little":
+            k = "i - {}".format(first)
+        else:
+            k = "{} - i".format(last)
+        if field["width"] > 1:
+            isFirst = "i == {}".format(first)
+        out += "\t\t\t\t\t{}::set(staged, {}, val, {});\n".format(fieldOf(field), k, isFirst)
+        out += "\t\t\t\t\tbreak;\n"
+    out += "\t\t\t}\n\t\t\tbreak;\n\n"
+out += "\t\tdefault:\n\t\t\tbreak;\n\t}\n}\n\n"
+
+out += "template<uint32_t Fields, typename Status>\n"
+out += "void docgreenApply(docgreen_packet_t packet, Status& status, const Status& staged)\n{\n"
+out += "\tswitch(packet)\n\t{\n"
+for packet in packets:
+    out += "\t\tcase DOCGREEN_PACKET_{}:\n".format(packet["name"])
+    for field in packet["fields"]:
+        out += "\t\t\t{}::copy(status, staged);\n".format(fieldOf(field))
+    out += "\t\t\tbreak;\n\n"
+out += "\t\tdefault:\n\t\t\tbreak;\n\t}\n}\n"
+
+with open(os.path.join(path, "DocGreenDisplay", "protocol-fields.h"), "w") as fd:
+    fd.write(out)
+
+#
+# dissector of the analysis tool
+#
+out = "#pragma once\n#include <stdint.h>\n\n"
+out += "// autogenerated by generate-protocol.py from docgreen-protocol.json, do not edit\n\n"
+out += "typedef enum : uint8_t\n{\n\tDISSECTOR_UINT,\n\tDISSECTOR_INT,\n\tDISSECTOR_FLAG,\n} dissector_type_t;\n\n"
+out += "typedef struct\n{\n\tconst char *name;\n\tuint8_t offset;\n\tuint8_t width;\n"
+out += "\tdissector_type_t type;\n\tbool bigEndian;\n\tuint8_t on; // flags only\n"
+out += "\tdouble scale;\n\tconst char *unit;\n} dissector_field_t;\n\n"
+out += "typedef struct\n{\n\tconst char *name;\n\tuint8_t address;\n\tuint8_t length;\n"
+out += "\tint16_t command; // -1 for any\n\tint16_t arg; // -1 for any\n"
+out += "\tconst dissector_field_t *fields;\n\tuint8_t fieldCount;\n} dissector_packet_t;\n\n"
+
+for i, packet in enumerate(packets):
+    out += "static const dissector_field_t dissectorFields{}[] = {{\n".format(i)
+    for field in packet["fields"]:
+        out += "\t{{\"{}\", {}, {}, DISSECTOR_{}, {}, {:#04x}, {}, \"{}\"}},\n".format(
+            field["name"], field["offset"], field["width"], field["type"].upper(),
+            "true" if field["endian"] == "big" else "false", field.get("on", 0),
+            repr(float(field.get("scale", 1))), field.get("unit", ""))
+    out += "};\n"
+out += "\nstatic const dissector_packet_t dissectorPackets[] = {\n"
+for i, packet in enumerate(packets):
+    out += "\t{{\"{}\", {:#04x}, {:#04x}, {}, {}, dissectorFields{}, {}}},\n".format(
+        packet["name"], packet["address"], packet["length"],
+        -1 if packet["command"] is None else "{:#04x}".format(packet["command"]),
+        -1 if packet["arg"] is None else "{:#04x}".format(packet["arg"]),
+        i, len(packet["fields"]))
+out += "};\n"
+
+with open(os.path.join(path, "SniffAnalyzer", "dissector.h"), "w") as fd:
+    fd.write(out)
+
+#
+# documentation
+#
+out = MD_BEGIN + "\n\n## Decoded fields\n"
+out += "Fields decoded by the firmware (see docgreen-protocol.json), byte indices as above.\n"
+for packet in packets:
+    out += "\n### Address `{:02X}` {}\n".format(packet["address"], packet["title"])
+    match = "length `{:02X}`".format(packet["length"])
+    if packet["command"] is not None:
+        match += ", command `{:02X}`".format(packet["command"])
+    if packet["arg"] is not None:
+        match += ", arg `{:02X}`".format(packet["arg"])
+    out += match + "\n\n"
+    out += "| bytes | field | type | scale | description |\n"
+    out += "| --- | --- | --- | --- | --- |\n"
+    for field in packet["fields"]:
+        first = field["offset"]
+        last = first + field["width"] - 1
+        bytes = str(first) if first == last else "{}-{}".format(first, last)
+        if field["type"] == "flag":
+            kind = "flag (`{:02X}`)".format(field["on"])
+        else:
+            kind = "{}{} {}".format(field["type"], field["width"] * 8,
+                "LE" if field["endian"] == "little" else "BE") if field["width"] > 1 \
+                else "{}8".format(field["type"])
+        scale = ""
+        if "unit" in field:
+            scale = "{} {}".format(field.get("scale", 1), field["unit"])
+        out += "| {} | {} | {} | {} | {} |\n".format(bytes, field["name"], kind, scale, field["doc"])
+
+mdPath = os.path.join(path, "docgreen-protocol.md")
+with open(mdPath) as fd:
+    md = fd.read()
+if MD_BEGIN in md:
+    md = md[:md.index(MD_BEGIN)]
+else:
+    md = md.rstrip("\n") + "\n\n"
+with open(mdPath, "w") as fd:
+    fd.write(md + out)
\ No newline at end of file